@@ -0,0 +1,218 @@
+// Microbenchmark: aht20_proto.h (table CRC, multiply-shift conversion)
+// against the previous bitwise crc8() and "/ 1048576" code, then the batch
+// aht20_decode_frames() kernels against its scalar path.
+//
+//   make bench
+//   ./bench/bench_proto [frames] [rounds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "aht20.h"
+#include "aht20_proto.h"
+
+// Previous implementation, kept here as the baseline
+static uint8_t legacy_crc8(const uint8_t *data, int len) {
+    uint8_t crc = 0xFF;
+    for (int i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int j = 0; j < 8; j++) {
+            if (crc & 0x80) {
+                crc = (crc << 1) ^ 0x31;
+            } else {
+                crc <<= 1;
+            }
+        }
+    }
+    return crc;
+}
+
+static int legacy_decode(const uint8_t *buf, int32_t *temperature, uint32_t *humidity) {
+    int tem, hum;
+
+    if (legacy_crc8(buf, 6) != buf[6]) {
+        return -1;
+    }
+    tem = ((buf[3] & 0xF) << 16) | (buf[4] << 8) | buf[5];
+    hum = (buf[1] << 12) | (buf[2] << 4) | (buf[3] >> 4);
+    *temperature = ((tem * 2000) / 1048576) - 500;
+    *humidity = ((hum * 1000) / 1048576);
+    return 0;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Every kernel must match aht20_decode_frame() frame by frame, including
+// busy and corrupted frames and every tail length
+static int batch_check(int kernel, const uint8_t *buf, size_t frames) {
+    size_t n = frames < 4096 ? frames : 4096;
+    uint8_t *bad = malloc(n * AHT20_FRAME_LEN);
+    int32_t *t = malloc(n * sizeof(*t));
+    uint32_t *h = malloc(n * sizeof(*h));
+    uint8_t *st = malloc(n);
+    int ret = 0;
+
+    memcpy(bad, buf, n * AHT20_FRAME_LEN);
+    for (size_t i = 0; i < n; i += 5) {
+        bad[i * AHT20_FRAME_LEN + (i % 7)] ^= 1 << (i % 8);
+    }
+    aht20_decode_set_kernel(kernel);
+    for (size_t len = n - 70; len <= n && ret == 0; len++) {
+        size_t ok = aht20_decode_frames(bad, len, t, h, st), want = 0;
+
+        for (size_t i = 0; i < len; i++) {
+            struct aht20_reading r;
+            int res = aht20_decode_frame(bad + i * AHT20_FRAME_LEN, &r);
+
+            want += res == AHT20_FRAME_OK;
+            if (st[i] != res || (res == AHT20_FRAME_OK && (t[i] != r.temperature || h[i] != r.humidity)) ||
+                (res != AHT20_FRAME_OK && (t[i] != 0 || h[i] != 0))) {
+                fprintf(stderr, "%s: mismatch at frame %zu of %zu\n", aht20_decode_kernel_name(), i, len);
+                ret = -1;
+                break;
+            }
+        }
+        if (ret == 0 && ok != want) {
+            fprintf(stderr, "%s: %zu ok frames, expected %zu\n", aht20_decode_kernel_name(), ok, want);
+            ret = -1;
+        }
+    }
+    free(bad);
+    free(t);
+    free(h);
+    free(st);
+    return ret;
+}
+
+static int bench_batch(const uint8_t *buf, size_t frames, int rounds) {
+    static const int kernels[] = { AHT20_DECODE_SCALAR, AHT20_DECODE_SSSE3, AHT20_DECODE_AVX2,
+                                   AHT20_DECODE_NEON };
+    int32_t *t = malloc(frames * sizeof(*t));
+    uint32_t *h = malloc(frames * sizeof(*h));
+    uint8_t *st = malloc(frames);
+    double scalar_rate = 0;
+
+    if (!t || !h || !st) {
+        perror("malloc");
+        return -1;
+    }
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        volatile size_t ok = 0;
+        double t0, ns, rate;
+
+        if (aht20_decode_set_kernel(kernels[k]) < 0) {
+            continue;
+        }
+        if (frames > 70 && batch_check(kernels[k], buf, frames) < 0) {
+            return -1;
+        }
+        t0 = now_ns();
+        for (int r = 0; r < rounds; r++) {
+            ok += aht20_decode_frames(buf, frames, t, h, st);
+        }
+        ns = (now_ns() - t0) / ((double)frames * rounds);
+        rate = 1e3 / ns;
+        if (kernels[k] == AHT20_DECODE_SCALAR) {
+            scalar_rate = rate;
+        }
+        printf("batch   %-6s  %6.2f ns/frame   %8.1f Mframes/s   x%.1f\n",
+               aht20_decode_kernel_name(), ns, rate, rate / scalar_rate);
+    }
+    aht20_decode_set_kernel(AHT20_DECODE_AUTO);
+    free(t);
+    free(h);
+    free(st);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    size_t frames = argc > 1 ? strtoul(argv[1], NULL, 0) : 1 << 16;
+    int rounds = argc > 2 ? atoi(argv[2]) : 50;
+    uint8_t *buf = malloc(frames * AHT20_FRAME_LEN);
+    volatile uint32_t sink = 0;
+    uint32_t seed = 12345;
+    double t0, legacy_ns, proto_ns, crc_legacy_ns, crc_proto_ns;
+
+    if (!buf || frames == 0 || rounds <= 0) {
+        fprintf(stderr, "usage: %s [frames] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    for (size_t i = 0; i < frames; i++) {
+        seed = seed * 1103515245u + 12345u;
+        aht20_encode_frame(buf + i * AHT20_FRAME_LEN, 0x1C,
+                           (seed >> 4) & 0xFFFFF, (seed >> 10) & 0xFFFFF);
+    }
+
+    // Sanity: both paths must agree on every frame
+    for (size_t i = 0; i < frames; i++) {
+        const uint8_t *f = buf + i * AHT20_FRAME_LEN;
+        struct aht20_reading r;
+        int32_t t;
+        uint32_t h;
+
+        if (legacy_decode(f, &t, &h) != 0 || aht20_decode_frame(f, &r) != AHT20_FRAME_OK ||
+            t != r.temperature || h != r.humidity) {
+            fprintf(stderr, "mismatch at frame %zu\n", i);
+            return 1;
+        }
+    }
+
+    t0 = now_ns();
+    for (int k = 0; k < rounds; k++) {
+        for (size_t i = 0; i < frames; i++) {
+            sink += legacy_crc8(buf + i * AHT20_FRAME_LEN, 6);
+        }
+    }
+    crc_legacy_ns = (now_ns() - t0) / ((double)frames * rounds);
+
+    t0 = now_ns();
+    for (int k = 0; k < rounds; k++) {
+        for (size_t i = 0; i < frames; i++) {
+            sink += aht20_crc8(buf + i * AHT20_FRAME_LEN, 6);
+        }
+    }
+    crc_proto_ns = (now_ns() - t0) / ((double)frames * rounds);
+
+    t0 = now_ns();
+    for (int k = 0; k < rounds; k++) {
+        for (size_t i = 0; i < frames; i++) {
+            int32_t t;
+            uint32_t h;
+            if (legacy_decode(buf + i * AHT20_FRAME_LEN, &t, &h) == 0) {
+                sink += t + h;
+            }
+        }
+    }
+    legacy_ns = (now_ns() - t0) / ((double)frames * rounds);
+
+    t0 = now_ns();
+    for (int k = 0; k < rounds; k++) {
+        for (size_t i = 0; i < frames; i++) {
+            struct aht20_reading r;
+            if (aht20_decode_frame(buf + i * AHT20_FRAME_LEN, &r) == AHT20_FRAME_OK) {
+                sink += r.temperature + r.humidity;
+            }
+        }
+    }
+    proto_ns = (now_ns() - t0) / ((double)frames * rounds);
+
+    printf("frames=%zu rounds=%d\n", frames, rounds);
+    printf("crc8    bitwise %6.2f ns/frame   table %6.2f ns/frame   x%.1f\n",
+           crc_legacy_ns, crc_proto_ns, crc_legacy_ns / crc_proto_ns);
+    printf("decode  legacy  %6.2f ns/frame   proto %6.2f ns/frame   x%.1f\n",
+           legacy_ns, proto_ns, legacy_ns / proto_ns);
+
+    if (bench_batch(buf, frames, rounds) < 0) {
+        return 1;
+    }
+
+    free(buf);
+    return sink == 0xFFFFFFFF;
+}
@@ -0,0 +1,442 @@
+// Latency and throughput of the read paths, as JSON on stdout.
+//
+//   lib_blocking  aht20_sensor_read() on one simulated sensor
+//   lib_sched     aht20_sched_read_all() over --sensors spread on --buses
+//   lib_sampler   aht20_sampler_latest() from --readers threads while a
+//                 sampler thread reads one simulated sensor; latency is per
+//                 call, averaged over batches of BENCH_SAMPLER_BATCH
+//   kernel_ioctl  AHT20_READ_SAMPLE on --dev (skipped if it cannot be opened;
+//                 load DO_AN_AHT20/aht20_sim.ko for a sensor without hardware)
+//
+//   make bench
+//   ./bench/bench_read [--samples N] [--sensors N] [--buses N] [--dev PATH]
+//                      [--readers N] [--conversion-us N] [--crc-ppm N] [--nak-ppm N]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include "aht20.h"
+#include "aht20_ioctl.h"
+#include "aht20_sim.h"
+
+#define BENCH_MAX_BUSES 16
+#define BENCH_MAX_READERS 64
+#define BENCH_SAMPLER_BATCH 10000
+
+struct bench_result {
+    const char *name;
+    size_t samples;             // readings attempted
+    size_t errors;
+    double *latency_us;         // per reading (per pass for lib_sched)
+    size_t nlatency;
+    double wall_s;
+    double user_s;
+    double sys_s;
+    double syscalls;            // ioctls in total, bus transfers and driver queries
+    double i2c_msgs;            // I2C messages in total
+    int sensors;
+    int buses;
+    int simulated;
+    struct aht20_sim_stats sim;
+};
+
+// Every simulated sensor in the library paths uses this
+static struct aht20_sim_config sim_cfg;
+
+static void sim_add(struct bench_result *res, const struct aht20_transport *t) {
+    struct aht20_sim_stats st;
+
+    if (aht20_transport_sim_stats(t, &st) < 0) {
+        return;
+    }
+    res->simulated = 1;
+    res->sim.triggers += st.triggers;
+    res->sim.frames += st.frames;
+    res->sim.busy_frames += st.busy_frames;
+    res->sim.crc_errors += st.crc_errors;
+    res->sim.naks += st.naks;
+}
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static double tv_s(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, size_t n, double p) {
+    size_t i;
+
+    if (n == 0) {
+        return 0;
+    }
+    i = (size_t)(p * (n - 1) + 0.5);
+    return sorted[i];
+}
+
+static void bench_begin(struct rusage *ru, double *t0) {
+    getrusage(RUSAGE_SELF, ru);
+    *t0 = now_us();
+}
+
+static void bench_end(struct bench_result *res, const struct rusage *ru0, double t0) {
+    struct rusage ru;
+
+    res->wall_s = (now_us() - t0) / 1e6;
+    getrusage(RUSAGE_SELF, &ru);
+    res->user_s = tv_s(ru.ru_utime) - tv_s(ru0->ru_utime);
+    res->sys_s = tv_s(ru.ru_stime) - tv_s(ru0->ru_stime);
+}
+
+static int bench_lib_blocking(struct bench_result *res, int samples) {
+    struct aht20_transport *t = aht20_transport_sim_open(&sim_cfg);
+    aht20_sensor *sensor;
+    struct rusage ru;
+    double t0;
+
+    if (!t) {
+        return -1;
+    }
+    sensor = aht20_sensor_open_transport(t, "sim", -1, 0);
+    if (!sensor) {
+        aht20_transport_close(t);
+        return -1;
+    }
+
+    res->name = "lib_blocking";
+    res->sensors = 1;
+    res->buses = 1;
+    res->latency_us = calloc(samples, sizeof(double));
+
+    bench_begin(&ru, &t0);
+    for (int i = 0; i < samples; i++) {
+        uint32_t temperature, humidity;
+        double start = now_us();
+
+        if (aht20_sensor_read(sensor, &temperature, &humidity) < 0) {
+            res->errors++;
+        }
+        res->latency_us[res->nlatency++] = now_us() - start;
+        res->samples++;
+    }
+    bench_end(res, &ru, t0);
+
+    res->syscalls = t->stats.xfers;
+    res->i2c_msgs = t->stats.msgs;
+    sim_add(res, t);
+
+    aht20_sensor_close(sensor);
+    aht20_transport_close(t);
+    return 0;
+}
+
+static int bench_lib_sched(struct bench_result *res, int passes, int nsensors, int nbuses) {
+    struct aht20_transport *t[BENCH_MAX_BUSES] = {0};
+    aht20_sensor **sensors = calloc(nsensors, sizeof(*sensors));
+    struct aht20_result *results = calloc(nsensors, sizeof(*results));
+    aht20_sched *sched = aht20_sched_create();
+    struct rusage ru;
+    double t0;
+    int ret = -1;
+
+    if (!sensors || !results || !sched) {
+        goto out;
+    }
+
+    for (int b = 0; b < nbuses; b++) {
+        t[b] = aht20_transport_sim_open(&sim_cfg);
+        if (!t[b]) {
+            goto out;
+        }
+    }
+
+    // Sensors round-robin over the buses, eight per mux
+    for (int i = 0; i < nsensors; i++) {
+        char bus[32];
+        int b = i % nbuses;
+        int slot = i / nbuses;
+
+        snprintf(bus, sizeof(bus), "sim-%d", b);
+        sensors[i] = aht20_sensor_open_transport(t[b], bus, 0x70 + slot / 8, slot % 8);
+        if (!sensors[i] || aht20_sched_add(sched, sensors[i]) < 0) {
+            goto out;
+        }
+    }
+
+    res->name = "lib_sched";
+    res->sensors = nsensors;
+    res->buses = nbuses;
+    res->latency_us = calloc(passes, sizeof(double));
+
+    bench_begin(&ru, &t0);
+    for (int p = 0; p < passes; p++) {
+        double start = now_us();
+        int ok = aht20_sched_read_all(sched, results, nsensors);
+
+        res->latency_us[res->nlatency++] = now_us() - start;
+        res->samples += nsensors;
+        res->errors += ok < 0 ? nsensors : nsensors - ok;
+    }
+    bench_end(res, &ru, t0);
+
+    for (int b = 0; b < nbuses; b++) {
+        res->syscalls += t[b]->stats.xfers;
+        res->i2c_msgs += t[b]->stats.msgs;
+        sim_add(res, t[b]);
+    }
+    ret = 0;
+
+out:
+    aht20_sched_destroy(sched);
+    for (int i = 0; sensors && i < nsensors; i++) {
+        aht20_sensor_close(sensors[i]);
+    }
+    for (int b = 0; b < nbuses; b++) {
+        aht20_transport_close(t[b]);
+    }
+    free(sensors);
+    free(results);
+    return ret;
+}
+
+struct sampler_reader {
+    const aht20_sampler *sampler;
+    double *latency_us;         // batches entries
+    int batches;
+    size_t errors;
+    pthread_t thread;
+};
+
+static void *sampler_reader(void *arg) {
+    struct sampler_reader *rd = arg;
+    struct aht20_snapshot snap;
+
+    for (int b = 0; b < rd->batches; b++) {
+        double start = now_us();
+
+        for (int i = 0; i < BENCH_SAMPLER_BATCH; i++) {
+            if (aht20_sampler_latest(rd->sampler, &snap) < 0) {
+                rd->errors++;
+            }
+        }
+        rd->latency_us[b] = (now_us() - start) / BENCH_SAMPLER_BATCH;
+    }
+    return NULL;
+}
+
+static int bench_lib_sampler(struct bench_result *res, int batches, int nreaders) {
+    struct aht20_transport *t = aht20_transport_sim_open(&sim_cfg);
+    struct aht20_sampler_config cfg = { 0 };
+    struct sampler_reader readers[BENCH_MAX_READERS];
+    struct aht20_snapshot snap;
+    aht20_sampler *sampler;
+    aht20_sensor *sensor;
+    struct rusage ru;
+    double t0;
+    int started = 0;
+
+    if (!t) {
+        return -1;
+    }
+    sensor = aht20_sensor_open_transport(t, "sim", -1, 0);
+    cfg.period_ms = sim_cfg.conversion_us / 1000 + 20;
+    sampler = sensor ? aht20_sampler_start(sensor, &cfg) : NULL;
+    if (!sampler) {
+        aht20_sensor_close(sensor);
+        aht20_transport_close(t);
+        return -1;
+    }
+    while (aht20_sampler_latest(sampler, &snap) < 0) {
+        usleep(1000);
+    }
+
+    res->name = "lib_sampler";
+    res->sensors = 1;
+    res->buses = 1;
+    res->latency_us = calloc((size_t)batches * nreaders, sizeof(double));
+
+    bench_begin(&ru, &t0);
+    for (int r = 0; r < nreaders; r++) {
+        readers[r] = (struct sampler_reader){ sampler, res->latency_us + (size_t)r * batches, batches, 0, 0 };
+        if (pthread_create(&readers[r].thread, NULL, sampler_reader, &readers[r]) != 0) {
+            break;
+        }
+        started++;
+    }
+    for (int r = 0; r < started; r++) {
+        pthread_join(readers[r].thread, NULL);
+        res->errors += readers[r].errors;
+        res->samples += (size_t)batches * BENCH_SAMPLER_BATCH;
+        res->nlatency += batches;
+    }
+    bench_end(res, &ru, t0);
+
+    // Readers make no syscalls; these are the sampler's, spread over all reads
+    aht20_sampler_stop(sampler);
+    res->syscalls = t->stats.xfers;
+    res->i2c_msgs = t->stats.msgs;
+    sim_add(res, t);
+
+    aht20_sensor_close(sensor);
+    aht20_transport_close(t);
+    return 0;
+}
+
+// I2C messages of one driver measurement, from its per-phase timings
+static int driver_msgs(const struct aht20_timings *tm) {
+    return (tm->status_us ? 2 : 0) + (tm->init_us ? 1 : 0) + 1 + tm->polls;
+}
+
+static int bench_kernel_ioctl(struct bench_result *res, int samples, const char *dev) {
+    struct rusage ru;
+    double t0;
+    int fd;
+
+    fd = open(dev, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    res->name = "kernel_ioctl";
+    res->sensors = 1;
+    res->buses = 1;
+    res->latency_us = calloc(samples, sizeof(double));
+
+    bench_begin(&ru, &t0);
+    for (int i = 0; i < samples; i++) {
+        struct aht20_sample sample;
+        struct aht20_timings tm;
+        double start = now_us();
+
+        if (ioctl(fd, AHT20_READ_SAMPLE, &sample) < 0) {
+            res->errors++;
+        }
+        res->latency_us[res->nlatency++] = now_us() - start;
+        res->samples++;
+        // AHT20_GET_TIMINGS runs inside the CPU window too, so it is counted
+        res->syscalls += 2;
+        if (ioctl(fd, AHT20_GET_TIMINGS, &tm) == 0) {
+            res->i2c_msgs += driver_msgs(&tm);
+        }
+    }
+    bench_end(res, &ru, t0);
+
+    close(fd);
+    return 0;
+}
+
+static void print_result(const struct bench_result *res, int last) {
+    double *sorted = malloc(res->nlatency * sizeof(double));
+    size_t ok = res->samples - res->errors;
+
+    memcpy(sorted, res->latency_us, res->nlatency * sizeof(double));
+    qsort(sorted, res->nlatency, sizeof(double), cmp_double);
+
+    printf("    {\n");
+    printf("      \"name\": \"%s\",\n", res->name);
+    printf("      \"sensors\": %d,\n", res->sensors);
+    printf("      \"buses\": %d,\n", res->buses);
+    printf("      \"samples\": %zu,\n", res->samples);
+    printf("      \"errors\": %zu,\n", res->errors);
+    printf("      \"latency_us\": { \"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f },\n",
+           percentile(sorted, res->nlatency, 0.50), percentile(sorted, res->nlatency, 0.99),
+           res->nlatency ? sorted[res->nlatency - 1] : 0.0);
+    printf("      \"samples_per_sec_per_sensor\": %.3f,\n",
+           res->wall_s > 0 ? ok / res->wall_s / res->sensors : 0.0);
+    printf("      \"samples_per_sec_per_bus\": %.3f,\n",
+           res->wall_s > 0 ? ok / res->wall_s / res->buses : 0.0);
+    printf("      \"syscalls_per_sample\": %.2f,\n", res->samples ? res->syscalls / res->samples : 0.0);
+    printf("      \"i2c_msgs_per_sample\": %.2f,\n", res->samples ? res->i2c_msgs / res->samples : 0.0);
+    printf("      \"cpu_us_per_sample\": %.2f,\n",
+           res->samples ? (res->user_s + res->sys_s) * 1e6 / res->samples : 0.0);
+    if (res->simulated) {
+        printf("      \"sim\": { \"triggers\": %llu, \"busy_frames\": %llu, \"crc_errors\": %llu, \"naks\": %llu },\n",
+               (unsigned long long)res->sim.triggers, (unsigned long long)res->sim.busy_frames,
+               (unsigned long long)res->sim.crc_errors, (unsigned long long)res->sim.naks);
+    }
+    printf("      \"wall_s\": %.3f\n", res->wall_s);
+    printf("    }%s\n", last ? "" : ",");
+
+    free(sorted);
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option opts[] = {
+        { "samples", required_argument, NULL, 'n' },
+        { "sensors", required_argument, NULL, 's' },
+        { "buses", required_argument, NULL, 'b' },
+        { "dev", required_argument, NULL, 'd' },
+        { "readers", required_argument, NULL, 'r' },
+        { "conversion-us", required_argument, NULL, 'c' },
+        { "crc-ppm", required_argument, NULL, 'e' },
+        { "nak-ppm", required_argument, NULL, 'k' },
+        { NULL, 0, NULL, 0 },
+    };
+    struct bench_result res[4];
+    int samples = 20, nsensors = 32, nbuses = 2, nreaders = 4;
+    const char *dev = "/dev/aht20_dev0";
+    int count = 0;
+    int c;
+
+    aht20_sim_defaults(&sim_cfg);
+    while ((c = getopt_long(argc, argv, "n:s:b:d:r:c:e:k:", opts, NULL)) != -1) {
+        switch (c) {
+        case 'n': samples = atoi(optarg); break;
+        case 's': nsensors = atoi(optarg); break;
+        case 'b': nbuses = atoi(optarg); break;
+        case 'd': dev = optarg; break;
+        case 'r': nreaders = atoi(optarg); break;
+        case 'c': sim_cfg.conversion_us = strtoul(optarg, NULL, 0); break;
+        case 'e': sim_cfg.crc_error_ppm = strtoul(optarg, NULL, 0); break;
+        case 'k': sim_cfg.nak_ppm = strtoul(optarg, NULL, 0); break;
+        default:
+            fprintf(stderr, "usage: %s [--samples N] [--sensors N] [--buses N] [--dev PATH]\n"
+                    "       [--readers N] [--conversion-us N] [--crc-ppm N] [--nak-ppm N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (samples <= 0 || nsensors <= 0 || nbuses <= 0 || nbuses > BENCH_MAX_BUSES ||
+        nsensors > nbuses * 64 || nreaders <= 0 || nreaders > BENCH_MAX_READERS) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    memset(res, 0, sizeof(res));
+    if (bench_lib_blocking(&res[count], samples) == 0) {
+        count++;
+    }
+    if (bench_lib_sched(&res[count], samples, nsensors, nbuses) == 0) {
+        count++;
+    }
+    if (bench_lib_sampler(&res[count], samples, nreaders) == 0) {
+        count++;
+    }
+    if (bench_kernel_ioctl(&res[count], samples, dev) == 0) {
+        count++;
+    } else {
+        fprintf(stderr, "kernel_ioctl: %s not available, skipped\n", dev);
+    }
+
+    printf("{\n  \"results\": [\n");
+    for (int i = 0; i < count; i++) {
+        print_result(&res[i], i == count - 1);
+        free(res[i].latency_us);
+    }
+    printf("  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,103 @@
+// Size and speed of aht20_rec against the CSV lines test_lib.c would print.
+// Samples are one per period with +-jitter_ms of timestamp noise and a
+// slow random walk in both channels, like a sensor on a shelf.
+//
+//   make bench
+//   ./bench/bench_rec [samples] [period_ms] [jitter_ms] [file]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "aht20_rec.h"
+
+#define BENCH_BATCH 256
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+    size_t samples = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+    long period_ms = argc > 2 ? atol(argv[2]) : 1000;
+    long jitter_ms = argc > 3 ? atol(argv[3]) : 2;
+    const char *path = argc > 4 ? argv[4] : "/tmp/bench_rec.aht20";
+    struct aht20_rec_sample s = { 1700000000LL * 1000000000LL, 250, 500 };
+    struct aht20_rec_reader *reader;
+    struct aht20_rec_info info;
+    aht20_rec *rec;
+    uint32_t seed = 12345;
+    size_t text_bytes = 0, read = 0;
+    int64_t sink = 0;
+    double t0, append_ns, scan_ns, data_bytes;
+    struct aht20_rec_sample batch[BENCH_BATCH];
+    char line[64];
+    size_t n;
+
+    if (samples == 0 || period_ms <= 0 || jitter_ms < 0) {
+        fprintf(stderr, "usage: %s [samples] [period_ms] [jitter_ms] [file]\n", argv[0]);
+        return 1;
+    }
+
+    // Room for every sample, so nothing wraps
+    unlink(path);
+    rec = aht20_rec_open(path, samples * 4 + (1 << 20), 0);
+    if (!rec) {
+        return 1;
+    }
+
+    t0 = now_ns();
+    for (size_t i = 0; i < samples; i++) {
+        seed = seed * 1103515245u + 12345u;
+        s.timestamp_ns = (1700000000LL * 1000 + (int64_t)i * period_ms +
+                          (jitter_ms ? (int64_t)(seed >> 8) % (2 * jitter_ms + 1) - jitter_ms : 0)) *
+                         1000000;
+        // One in four samples moves by 0.1
+        if (((seed >> 20) & 3) == 0) {
+            s.temperature += (seed >> 22) & 1 ? 1 : -1;
+        }
+        if (((seed >> 24) & 3) == 0) {
+            s.humidity += (seed >> 26) & 1 ? 1 : -1;
+        }
+        aht20_rec_append(rec, &s);
+        text_bytes += snprintf(line, sizeof(line), "%lld,%d.%d,%u.%u\n", (long long)s.timestamp_ns,
+                               s.temperature / 10, s.temperature % 10, s.humidity / 10, s.humidity % 10);
+    }
+    append_ns = (now_ns() - t0) / samples;
+    aht20_rec_close(rec);
+
+    reader = aht20_rec_reader_open(path);
+    if (!reader) {
+        return 1;
+    }
+    aht20_rec_reader_info(reader, &info);
+    data_bytes = (double)(info.last_block - info.first_block + 1) * info.block_size;
+
+    t0 = now_ns();
+    while ((n = aht20_rec_reader_read(reader, batch, BENCH_BATCH)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            sink += batch[i].temperature + batch[i].humidity;
+        }
+        read += n;
+    }
+    scan_ns = now_ns() - t0;
+    aht20_rec_reader_close(reader);
+
+    if (read != samples) {
+        fprintf(stderr, "read back %zu of %zu samples\n", read, samples);
+        return 1;
+    }
+
+    printf("samples=%zu period_ms=%ld jitter_ms=%ld\n", samples, period_ms, jitter_ms);
+    printf("size    rec %6.2f B/sample   csv %6.2f B/sample   x%.1f\n",
+           data_bytes / samples, (double)text_bytes / samples, text_bytes / data_bytes);
+    printf("append  %6.2f ns/sample\n", append_ns);
+    printf("scan    %6.2f ns/sample   %.0f MB/s of file   %.1f Msamples/s\n",
+           scan_ns / samples, data_bytes / scan_ns * 1e3, samples / scan_ns * 1e3);
+
+    unlink(path);
+    return sink == INT64_MIN;
+}
@@ -1,7 +1,13 @@
 #ifndef AHT20_H
 #define AHT20_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include "aht20_transport.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 #define I2C_DEVICE "/dev/i2c-1"
 #define AHT20_ADDR 0x38
@@ -12,11 +18,145 @@ int aht20_read_temperature(int file, uint32_t *temperature);
 int aht20_read_humidity(int file, uint32_t *humidity);
 void aht20_close(int file);
 
+// Split-phase read for event loops. aht20_trigger() starts a conversion and
+// returns a file descriptor that becomes readable (poll/epoll) once the
+// conversion time has passed. aht20_fetch() then reads the frame and returns
+// 0 with both values or -1 on error, and closes the fd. It keeps no state,
+// so a frame still busy fails with ETIMEDOUT; aht20_sensor_fetch() reads it
+// again instead.
+int aht20_trigger(int file);
+int aht20_fetch(int file, int ready_fd, uint32_t *temperature, uint32_t *humidity);
+
+// Sensor handle. All AHT20s answer at 0x38, so more than one per bus sits
+// behind a TCA9548A-style mux: mux_addr (0x70..0x77) and mux_channel (0..7),
+// or mux_addr = -1 for a sensor directly on the bus. bus = NULL means
+// I2C_DEVICE. aht20_sensor_read() assumes at most one mux per bus; use the
+// scheduler below when several muxes share a bus.
+typedef struct aht20_sensor aht20_sensor;
+
+aht20_sensor *aht20_sensor_open(const char *bus, int mux_addr, int mux_channel);
+// Same on a caller-owned transport, e.g. one shared by all sensors of a bus
+// or aht20_transport_mem_open(). bus names the bus for the scheduler.
+aht20_sensor *aht20_sensor_open_transport(struct aht20_transport *transport, const char *bus,
+                                          int mux_addr, int mux_channel);
+struct aht20_transport *aht20_sensor_transport(aht20_sensor *sensor);
+int aht20_sensor_read(aht20_sensor *sensor, uint32_t *temperature, uint32_t *humidity);
+// Split-phase read on a handle. Like aht20_trigger()/aht20_fetch(), except that
+// aht20_sensor_fetch() returns 1 while the sensor is busy or a fault is being
+// recovered: the same fd has been re-armed, wait for it again. The fd is
+// closed unless it returns 1.
+// The mux channel is selected again before the fetch, so many sensors on one
+// bus can have conversions in flight from a single thread. Like
+// aht20_sensor_read(), this assumes at most one mux per bus.
+int aht20_sensor_trigger(aht20_sensor *sensor);
+int aht20_sensor_fetch(aht20_sensor *sensor, int ready_fd, uint32_t *temperature,
+                       uint32_t *humidity);
+// Reads through a handle, scheduler passes included, recover from faults
+// instead of failing at once: a busy frame is read again, a bad CRC or a NAK
+// starts a new conversion and repeated faults send a soft reset (0xBA) and
+// re-initialize the sensor, all within a deadline (AHT20_RECOVERY_DEFAULT_MS,
+// 0 turns recovery off).
+// The raw-fd aht20_read_*() calls use the default deadline; aht20_fetch()
+// on a raw fd keeps no state and fails on the first fault, busy included.
+#define AHT20_RECOVERY_DEFAULT_MS 500
+
+struct aht20_sensor_stats {
+    uint64_t reads;
+    uint64_t busy_refetches;    // frame still busy, read again without a new trigger
+    uint64_t crc_errors;
+    uint64_t i2c_errors;        // NAKs and other transfer failures
+    uint64_t retriggers;        // new conversion after a fault
+    uint64_t soft_resets;       // 0xBA + re-init
+    uint64_t recovered;         // reads that succeeded after at least one fault
+    uint64_t failures;          // reads that gave up
+};
+
+void aht20_sensor_set_recovery(aht20_sensor *sensor, unsigned int deadline_ms);
+// Counters are written by the thread reading the sensor; copies taken from
+// another thread may be a reading behind
+void aht20_sensor_get_stats(const aht20_sensor *sensor, struct aht20_sensor_stats *stats);
+const char *aht20_sensor_bus(const aht20_sensor *sensor);
+void aht20_sensor_close(aht20_sensor *sensor);
+
+// Multi-sensor scheduler: one worker thread per bus triggers every sensor on
+// its bus back to back, waits one conversion window, then collects all
+// frames. Buses run in parallel, so a pass costs about one conversion time
+// per bus instead of one per sensor. The scheduler tracks which mux channel
+// is on, so do not mix it with aht20_sensor_read() on the same bus.
+typedef struct aht20_sched aht20_sched;
+
+struct aht20_result {
+    aht20_sensor *sensor;
+    int status;                 // 0 ok, -1 failed
+    uint32_t temperature;       // 0.1 C, two's complement
+    uint32_t humidity;          // 0.1 %RH
+};
+
+aht20_sched *aht20_sched_create(void);
+// Sensors must be added before the first pass; results keep the add order
+int aht20_sched_add(aht20_sched *sched, aht20_sensor *sensor);
+size_t aht20_sched_count(const aht20_sched *sched);
+// One pass over all sensors; results must hold aht20_sched_count() entries.
+// Returns the number of successful readings or -1.
+int aht20_sched_read_all(aht20_sched *sched, struct aht20_result *results, size_t n);
+// Stops the workers; does not close the sensors
+void aht20_sched_destroy(aht20_sched *sched);
+
+// Background sampler: a thread reads one sensor every period_ms and
+// publishes the result to a seqlock snapshot on its own cache line.
+// aht20_sampler_latest() takes no lock and makes no system call, so any
+// number of threads can poll it. The sensor belongs to the sampler until
+// aht20_sampler_stop(). Link with -pthread.
+#define AHT20_SAMPLER_FIFO 0x1      // SCHED_FIFO at priority; needs CAP_SYS_NICE or RLIMIT_RTPRIO
+#define AHT20_SAMPLER_MLOCK 0x2     // mlockall(MCL_CURRENT | MCL_FUTURE), process wide
+
+struct aht20_sampler_config {
+    uint32_t period_ms;
+    int flags;                  // AHT20_SAMPLER_*
+    int priority;               // 1..99 with AHT20_SAMPLER_FIFO
+};
+
+struct aht20_snapshot {
+    uint64_t seq;               // successful readings so far, 0 before the first
+    int64_t timestamp_ns;       // CLOCK_MONOTONIC when the frame was read
+    uint32_t temperature;       // 0.1 C, two's complement
+    uint32_t humidity;          // 0.1 %RH
+    uint32_t errors;            // failed readings so far
+};
+
+typedef struct aht20_sampler aht20_sampler;
+
+aht20_sampler *aht20_sampler_start(aht20_sensor *sensor, const struct aht20_sampler_config *cfg);
+// Latest snapshot; -1 with errno EAGAIN until the first successful reading
+int aht20_sampler_latest(const aht20_sampler *sampler, struct aht20_snapshot *snap);
+void aht20_sampler_stop(aht20_sampler *sampler);
+
+// Batch decode of n packed 7-byte frames, e.g. raw captures being replayed.
+// status[i] gets AHT20_FRAME_OK/BUSY/CRC (aht20_proto.h). temperature[i]
+// (0.1 C) and humidity[i] (0.1 %RH) are set for OK frames and 0 otherwise.
+// Returns the number of OK frames. Results match aht20_decode_frame(); the
+// kernel (AVX2, SSSE3, NEON or scalar) is picked for the CPU on first use.
+#define AHT20_DECODE_AUTO 0
+#define AHT20_DECODE_SCALAR 1
+#define AHT20_DECODE_SSSE3 2
+#define AHT20_DECODE_AVX2 3
+#define AHT20_DECODE_NEON 4
+
+size_t aht20_decode_frames(const uint8_t *frames, size_t n, int32_t *temperature,
+                           uint32_t *humidity, uint8_t *status);
+// Force a kernel for the whole process, e.g. to compare against
+// AHT20_DECODE_SCALAR; -1 with errno ENOTSUP if this CPU or build lacks it
+int aht20_decode_set_kernel(int kernel);
+const char *aht20_decode_kernel_name(void);
+
 // Bien
 #define AHT20_ADDR 0x38
 #define AHT20_CMD_MEASURE 0xAC
 #define AHT20_CMD_STATUS 0x71
 #define AHT20_CMD_INIT 0xBE
 
+#ifdef __cplusplus
+}
+#endif
 
 #endif // AHT20_H
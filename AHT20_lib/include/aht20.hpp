@@ -0,0 +1,347 @@
+#ifndef AHT20_HPP
+#define AHT20_HPP
+
+// Header-only C++20 wrapper for libaht20: a move-only sensor handle, typed
+// samples and co_await on the split-phase read. Link with libaht20.a -pthread.
+//
+//   aht20::EpollExecutor ex;
+//   auto s = aht20::Sensor::open("/dev/i2c-1", 0x70, 3);
+//   s.bind(ex);
+//   [](aht20::Sensor &s) -> aht20::Task {
+//       aht20::Sample v = co_await s.sample();
+//       ...
+//   }(s);
+//   ex.run();
+//
+// The coroutine is suspended while the conversion runs: the trigger arms a
+// timerfd and the executor resumes the coroutine when it fires, so one thread
+// can keep hundreds of conversions in flight. The trigger itself is a few
+// blocking bus transfers, plus a 10 ms 0xBE init the first time a sensor is
+// found uncalibrated.
+
+#include <cerrno>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "aht20.h"
+
+namespace aht20 {
+
+// libaht20 reports failures with -1 and errno, plus a message on stderr.
+// Protocol errors set errno too: EBADMSG for a bad CRC, ETIMEDOUT for a
+// sensor still busy. Callers clear errno first, so a failure that leaves it
+// unset comes out as EIO.
+class Error : public std::system_error {
+public:
+    Error(int err, const char *what) : std::system_error(err, std::generic_category(), what) {}
+};
+
+inline void throw_errno(const char *what) {
+    throw Error(errno ? errno : EIO, what);
+}
+
+// 0.1 degC, as the C API and the kernel driver report it
+class Temperature {
+public:
+    constexpr Temperature() = default;
+    constexpr explicit Temperature(int32_t deci_celsius) : value_(deci_celsius) {}
+    constexpr int32_t deci_celsius() const { return value_; }
+    constexpr double celsius() const { return value_ / 10.0; }
+    constexpr auto operator<=>(const Temperature &) const = default;
+
+private:
+    int32_t value_ = 0;
+};
+
+// 0.1 %RH
+class Humidity {
+public:
+    constexpr Humidity() = default;
+    constexpr explicit Humidity(uint32_t deci_percent) : value_(deci_percent) {}
+    constexpr uint32_t deci_percent() const { return value_; }
+    constexpr double percent() const { return value_ / 10.0; }
+    constexpr auto operator<=>(const Humidity &) const = default;
+
+private:
+    uint32_t value_ = 0;
+};
+
+struct Sample {
+    using clock = std::chrono::steady_clock;   // CLOCK_MONOTONIC, like aht20_sample
+
+    clock::time_point timestamp;                // frame fetched
+    clock::duration latency;                    // trigger to fetch
+    Temperature temperature;
+    Humidity humidity;
+};
+
+// Executor hook. wait_readable() must call waiter.ready() once, from the
+// thread driving the coroutines, after fd becomes readable. The fd stays
+// owned by the caller; it may be closed inside ready() or passed to
+// wait_readable() again. Adapt this to an existing event loop or use
+// EpollExecutor below.
+class Waiter {
+public:
+    virtual void ready() = 0;
+
+protected:
+    ~Waiter() = default;
+};
+
+class Executor {
+public:
+    virtual ~Executor() = default;
+    virtual void wait_readable(int fd, Waiter &waiter) = 0;
+};
+
+// Single-threaded epoll loop
+class EpollExecutor : public Executor {
+public:
+    EpollExecutor() : epfd_(epoll_create1(EPOLL_CLOEXEC)) {
+        if (epfd_ < 0) {
+            throw_errno("epoll_create1");
+        }
+    }
+    EpollExecutor(const EpollExecutor &) = delete;
+    EpollExecutor &operator=(const EpollExecutor &) = delete;
+    ~EpollExecutor() override { close(epfd_); }
+
+    void wait_readable(int fd, Waiter &waiter) override {
+        struct epoll_event ev = {};
+
+        // One shot: a busy sensor re-arms the same timerfd and comes back
+        ev.events = EPOLLIN | EPOLLONESHOT;
+        ev.data.ptr = &waiter;
+        if (epoll_ctl(epfd_, EPOLL_CTL_MOD, fd, &ev) < 0) {
+            if (errno != ENOENT || epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                throw_errno("epoll_ctl");
+            }
+        }
+        pending_++;
+    }
+
+    // Dispatch ready waiters; returns how many ran, 0 on timeout
+    int run_once(int timeout_ms = -1) {
+        struct epoll_event events[64];
+        int n;
+
+        if (pending_ == 0) {
+            return 0;
+        }
+        n = epoll_wait(epfd_, events, 64, timeout_ms);
+        if (n < 0) {
+            if (errno == EINTR) {
+                return 0;
+            }
+            throw_errno("epoll_wait");
+        }
+        for (int i = 0; i < n; i++) {
+            pending_--;
+            static_cast<Waiter *>(events[i].data.ptr)->ready();
+        }
+        return n;
+    }
+
+    // Until no coroutine waits on this executor
+    void run() {
+        while (pending_ > 0) {
+            run_once();
+        }
+    }
+
+    size_t pending() const { return pending_; }
+
+private:
+    int epfd_;
+    size_t pending_ = 0;
+};
+
+// Fire-and-forget coroutine, starts at once and frees itself at the end.
+// Exceptions must be caught inside; one that escapes terminates.
+struct Task {
+    struct promise_type {
+        Task get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// Awaitable returned by Sensor::sample(). Lives in the coroutine frame
+// while the conversion runs, so it is the Waiter handed to the executor.
+class SampleAwaiter : private Waiter {
+public:
+    SampleAwaiter(aht20_sensor *sensor, Executor &executor)
+        : sensor_(sensor), executor_(executor) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    // Returns false (resume now) when the trigger fails
+    bool await_suspend(std::coroutine_handle<> handle) {
+        handle_ = handle;
+        start_ = Sample::clock::now();
+        errno = 0;
+        fd_ = aht20_sensor_trigger(sensor_);
+        if (fd_ < 0) {
+            err_ = errno ? errno : EIO;
+            return false;
+        }
+        executor_.wait_readable(fd_, *this);
+        return true;
+    }
+
+    Sample await_resume() {
+        if (err_) {
+            throw Error(err_, "aht20 sample");
+        }
+        return sample_;
+    }
+
+private:
+    void ready() override {
+        uint32_t temperature;
+        uint32_t humidity;
+        int ret;
+
+        errno = 0;
+        ret = aht20_sensor_fetch(sensor_, fd_, &temperature, &humidity);
+        if (ret == 1) {
+            // Still busy: fd_ has been re-armed for the retry delay
+            executor_.wait_readable(fd_, *this);
+            return;
+        }
+        if (ret < 0) {
+            err_ = errno ? errno : EIO;
+        } else {
+            sample_.timestamp = Sample::clock::now();
+            sample_.latency = sample_.timestamp - start_;
+            sample_.temperature = Temperature(static_cast<int32_t>(temperature));
+            sample_.humidity = Humidity(humidity);
+        }
+        handle_.resume();
+    }
+
+    aht20_sensor *sensor_;
+    Executor &executor_;
+    std::coroutine_handle<> handle_;
+    Sample::clock::time_point start_;
+    Sample sample_;
+    int fd_ = -1;
+    int err_ = 0;
+};
+
+// Owns an aht20_sensor handle. Move-only; closed by the destructor.
+// Only one sample() may be in flight per sensor.
+class Sensor {
+public:
+    Sensor() = default;
+    explicit Sensor(aht20_sensor *handle) noexcept : handle_(handle) {}
+
+    // bus empty means I2C_DEVICE; mux_addr -1 for a sensor directly on the bus
+    static Sensor open(const std::string &bus = {}, int mux_addr = -1, int mux_channel = 0) {
+        aht20_sensor *handle;
+
+        errno = 0;
+        handle = aht20_sensor_open(bus.empty() ? nullptr : bus.c_str(), mux_addr, mux_channel);
+        if (!handle) {
+            throw_errno("aht20_sensor_open");
+        }
+        return Sensor(handle);
+    }
+
+    // On a caller-owned transport, which must outlive the sensor
+    static Sensor open(struct aht20_transport *transport, const std::string &bus = {},
+                       int mux_addr = -1, int mux_channel = 0) {
+        aht20_sensor *handle;
+
+        errno = 0;
+        handle = aht20_sensor_open_transport(transport, bus.empty() ? nullptr : bus.c_str(),
+                                             mux_addr, mux_channel);
+        if (!handle) {
+            throw_errno("aht20_sensor_open_transport");
+        }
+        return Sensor(handle);
+    }
+
+    Sensor(const Sensor &) = delete;
+    Sensor &operator=(const Sensor &) = delete;
+
+    Sensor(Sensor &&other) noexcept
+        : handle_(std::exchange(other.handle_, nullptr)),
+          executor_(std::exchange(other.executor_, nullptr)) {}
+
+    Sensor &operator=(Sensor &&other) noexcept {
+        if (this != &other) {
+            reset(std::exchange(other.handle_, nullptr));
+            executor_ = std::exchange(other.executor_, nullptr);
+        }
+        return *this;
+    }
+
+    ~Sensor() { reset(); }
+
+    void reset(aht20_sensor *handle = nullptr) noexcept {
+        aht20_sensor_close(std::exchange(handle_, handle));
+    }
+
+    aht20_sensor *release() noexcept { return std::exchange(handle_, nullptr); }
+    aht20_sensor *native_handle() const noexcept { return handle_; }
+    explicit operator bool() const noexcept { return handle_ != nullptr; }
+    std::string bus() const { return aht20_sensor_bus(handle_); }
+
+    // Fault recovery budget per read; zero fails on the first fault
+    void set_recovery(std::chrono::milliseconds deadline) noexcept {
+        aht20_sensor_set_recovery(handle_, static_cast<unsigned int>(deadline.count()));
+    }
+    aht20_sensor_stats stats() const noexcept {
+        aht20_sensor_stats stats;
+        aht20_sensor_get_stats(handle_, &stats);
+        return stats;
+    }
+
+    // Executor used by sample() without an argument
+    void bind(Executor &executor) noexcept { executor_ = &executor; }
+
+    // Blocking read, one conversion
+    Sample read() {
+        Sample s;
+        uint32_t temperature;
+        uint32_t humidity;
+        auto start = Sample::clock::now();
+
+        errno = 0;
+        if (aht20_sensor_read(handle_, &temperature, &humidity) < 0) {
+            throw_errno("aht20_sensor_read");
+        }
+        s.timestamp = Sample::clock::now();
+        s.latency = s.timestamp - start;
+        s.temperature = Temperature(static_cast<int32_t>(temperature));
+        s.humidity = Humidity(humidity);
+        return s;
+    }
+
+    // co_await sensor.sample(): suspends until the conversion is done
+    SampleAwaiter sample(Executor &executor) { return SampleAwaiter(handle_, executor); }
+
+    SampleAwaiter sample() {
+        if (!executor_) {
+            throw Error(EINVAL, "aht20::Sensor has no executor");
+        }
+        return SampleAwaiter(handle_, *executor_);
+    }
+
+private:
+    aht20_sensor *handle_ = nullptr;
+    Executor *executor_ = nullptr;
+};
+
+} // namespace aht20
+
+#endif // AHT20_HPP
@@ -0,0 +1,139 @@
+#ifndef AHT20_PROTO_H
+#define AHT20_PROTO_H
+
+// AHT20 protocol core shared by DO_AN_AHT20/aht20_driver.c and libaht20.
+// Header-only and freestanding: no libc, no allocation, no division, so
+// the same code builds in the kernel and in user space.
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#endif
+
+// Commands
+#define AHT20_CMD_MEASURE 0xAC
+#define AHT20_CMD_STATUS 0x71
+#define AHT20_CMD_INIT 0xBE
+#define AHT20_CMD_SOFT_RESET 0xBA
+
+// Frame: status, 20 bit S_RH, 20 bit S_T, CRC over the first 6 bytes
+#define AHT20_FRAME_LEN 7
+#define AHT20_STATUS_BUSY 0x80
+#define AHT20_STATUS_CALIBRATED 0x18
+
+// aht20_decode_frame() results
+#define AHT20_FRAME_OK 0
+#define AHT20_FRAME_BUSY 1
+#define AHT20_FRAME_CRC 2
+
+// CRC-8, polynomial 0x31 (x^8 + x^5 + x^4 + 1), init 0xFF, MSB first.
+// The table is built by the preprocessor: without the init value the CRC
+// is linear over GF(2), so entry i is the XOR of the entries of its set
+// bits (0x01 -> 0x31, 0x02 -> 0x62, ..., 0x80 -> 0x7A).
+#define AHT20_CRC_BIT(i, b, v) ((((i) >> (b)) & 1) ? (v) : 0)
+#define AHT20_CRC_ENTRY(i) \
+    (AHT20_CRC_BIT(i, 0, 0x31) ^ AHT20_CRC_BIT(i, 1, 0x62) ^ \
+     AHT20_CRC_BIT(i, 2, 0xC4) ^ AHT20_CRC_BIT(i, 3, 0xB9) ^ \
+     AHT20_CRC_BIT(i, 4, 0x43) ^ AHT20_CRC_BIT(i, 5, 0x86) ^ \
+     AHT20_CRC_BIT(i, 6, 0x3D) ^ AHT20_CRC_BIT(i, 7, 0x7A))
+#define AHT20_CRC_ROW(r) \
+    AHT20_CRC_ENTRY((r) + 0),  AHT20_CRC_ENTRY((r) + 1),  \
+    AHT20_CRC_ENTRY((r) + 2),  AHT20_CRC_ENTRY((r) + 3),  \
+    AHT20_CRC_ENTRY((r) + 4),  AHT20_CRC_ENTRY((r) + 5),  \
+    AHT20_CRC_ENTRY((r) + 6),  AHT20_CRC_ENTRY((r) + 7),  \
+    AHT20_CRC_ENTRY((r) + 8),  AHT20_CRC_ENTRY((r) + 9),  \
+    AHT20_CRC_ENTRY((r) + 10), AHT20_CRC_ENTRY((r) + 11), \
+    AHT20_CRC_ENTRY((r) + 12), AHT20_CRC_ENTRY((r) + 13), \
+    AHT20_CRC_ENTRY((r) + 14), AHT20_CRC_ENTRY((r) + 15)
+
+static const uint8_t aht20_crc_table[256] = {
+    AHT20_CRC_ROW(0x00), AHT20_CRC_ROW(0x10), AHT20_CRC_ROW(0x20), AHT20_CRC_ROW(0x30),
+    AHT20_CRC_ROW(0x40), AHT20_CRC_ROW(0x50), AHT20_CRC_ROW(0x60), AHT20_CRC_ROW(0x70),
+    AHT20_CRC_ROW(0x80), AHT20_CRC_ROW(0x90), AHT20_CRC_ROW(0xA0), AHT20_CRC_ROW(0xB0),
+    AHT20_CRC_ROW(0xC0), AHT20_CRC_ROW(0xD0), AHT20_CRC_ROW(0xE0), AHT20_CRC_ROW(0xF0),
+};
+
+static inline uint8_t aht20_crc8(const uint8_t *data, unsigned int len)
+{
+    uint8_t crc = 0xFF;
+
+    while (len--)
+        crc = aht20_crc_table[crc ^ *data++];
+    return crc;
+}
+
+// Unit conversion, multiply-shift only. S is a 20 bit raw value, so the
+// products stay below 2^32.
+//   T  = S_T  / 2^20 * 200 - 50   ->  0.1 C: S*125 >> 16,   milli C: S*3125 >> 14
+//   RH = S_RH / 2^20 * 100        ->  0.1 %: S*125 >> 17,   milli %: S*3125 >> 15
+// The 0.1 unit results are identical to the old (S * 2000) / 1048576 form.
+static inline int32_t aht20_temp_deci(uint32_t raw)
+{
+    return (int32_t)((raw * 125u) >> 16) - 500;
+}
+
+static inline uint32_t aht20_hum_deci(uint32_t raw)
+{
+    return (raw * 125u) >> 17;
+}
+
+static inline int32_t aht20_temp_milli(uint32_t raw)
+{
+    return (int32_t)((raw * 3125u) >> 14) - 50000;
+}
+
+static inline uint32_t aht20_hum_milli(uint32_t raw)
+{
+    return (raw * 3125u) >> 15;
+}
+
+// Both channels of one frame
+struct aht20_reading {
+    uint8_t status;
+    uint32_t raw_temperature;   // S_T
+    uint32_t raw_humidity;      // S_RH
+    int32_t temperature;        // 0.1 C
+    uint32_t humidity;          // 0.1 %RH
+};
+
+static inline uint32_t aht20_frame_raw_humidity(const uint8_t *frame)
+{
+    return ((uint32_t)frame[1] << 12) | ((uint32_t)frame[2] << 4) | (frame[3] >> 4);
+}
+
+static inline uint32_t aht20_frame_raw_temperature(const uint8_t *frame)
+{
+    return ((uint32_t)(frame[3] & 0xF) << 16) | ((uint32_t)frame[4] << 8) | frame[5];
+}
+
+// Check busy bit and CRC, then unpack both channels
+static inline int aht20_decode_frame(const uint8_t *frame, struct aht20_reading *r)
+{
+    if (frame[0] & AHT20_STATUS_BUSY)
+        return AHT20_FRAME_BUSY;
+    if (aht20_crc8(frame, 6) != frame[6])
+        return AHT20_FRAME_CRC;
+
+    r->status = frame[0];
+    r->raw_humidity = aht20_frame_raw_humidity(frame);
+    r->raw_temperature = aht20_frame_raw_temperature(frame);
+    r->temperature = aht20_temp_deci(r->raw_temperature);
+    r->humidity = aht20_hum_deci(r->raw_humidity);
+    return AHT20_FRAME_OK;
+}
+
+// Build a frame, e.g. for a simulated sensor or a benchmark
+static inline void aht20_encode_frame(uint8_t *frame, uint8_t status,
+                                      uint32_t raw_humidity, uint32_t raw_temperature)
+{
+    frame[0] = status;
+    frame[1] = (uint8_t)(raw_humidity >> 12);
+    frame[2] = (uint8_t)(raw_humidity >> 4);
+    frame[3] = (uint8_t)(((raw_humidity & 0xF) << 4) | ((raw_temperature >> 16) & 0xF));
+    frame[4] = (uint8_t)(raw_temperature >> 8);
+    frame[5] = (uint8_t)raw_temperature;
+    frame[6] = aht20_crc8(frame, 6);
+}
+
+#endif // AHT20_PROTO_H
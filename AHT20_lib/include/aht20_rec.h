@@ -0,0 +1,78 @@
+#ifndef AHT20_REC_H
+#define AHT20_REC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Binary time-series recorder: a fixed-size file, mmap'd and used as a ring
+// of blocks. The oldest block is overwritten once the file is full.
+//
+// Every block starts with its first sample in full, then encodes the rest
+// as zigzag varints. Timestamps are delta-of-delta in resolution_ns units,
+// so a steady sampling period costs one byte. Temperature and humidity are
+// deltas from the previous sample. A periodic sample takes about 3 bytes
+// against 25-30 for a CSV line.
+//
+// The file header is followed by an index with one entry per block slot:
+// the block sequence number and its first timestamp. A seek is a binary
+// search over the index and a decode of one block.
+//
+// One writer per file. Readers may map the file while it is written; they
+// see the samples of a block up to the last completed append.
+
+#define AHT20_REC_MAGIC "AHT20REC"
+#define AHT20_REC_VERSION 1
+#define AHT20_REC_BLOCK_SIZE 4096
+#define AHT20_REC_DEFAULT_RESOLUTION_NS 1000000  // 1 ms
+
+struct aht20_rec_sample {
+    int64_t timestamp_ns;       // any clock, non-decreasing; CLOCK_REALTIME for logs
+    int32_t temperature;        // 0.1 C
+    uint32_t humidity;          // 0.1 %RH
+};
+
+typedef struct aht20_rec aht20_rec;
+
+// Creates path with size bytes (at least two blocks plus the header), or
+// reopens an existing recording and appends after its last sample; size
+// and resolution_ns are then taken from the file. resolution_ns = 0 means
+// AHT20_REC_DEFAULT_RESOLUTION_NS. Timestamps are truncated to it.
+aht20_rec *aht20_rec_open(const char *path, size_t size, uint32_t resolution_ns);
+int aht20_rec_append(aht20_rec *rec, const struct aht20_rec_sample *sample);
+// msync() of the mapping; the kernel also writes it back on its own
+int aht20_rec_sync(aht20_rec *rec);
+void aht20_rec_close(aht20_rec *rec);
+
+// Reader, on a read-only mapping. Samples come oldest first.
+typedef struct aht20_rec_reader aht20_rec_reader;
+
+struct aht20_rec_info {
+    uint32_t block_size;
+    uint32_t nblocks;
+    uint32_t resolution_ns;
+    uint64_t first_block;       // oldest sequence number still in the file
+    uint64_t last_block;        // block being written
+    size_t file_size;
+};
+
+aht20_rec_reader *aht20_rec_reader_open(const char *path);
+void aht20_rec_reader_info(const aht20_rec_reader *reader, struct aht20_rec_info *info);
+// Position before the first sample with timestamp_ns >= timestamp_ns
+int aht20_rec_reader_seek(aht20_rec_reader *reader, int64_t timestamp_ns);
+void aht20_rec_reader_rewind(aht20_rec_reader *reader);
+// 1 with a sample, 0 at the end, -1 on a corrupt block (which is skipped,
+// so the caller can keep calling)
+int aht20_rec_reader_next(aht20_rec_reader *reader, struct aht20_rec_sample *sample);
+// Up to n samples, skipping corrupt blocks; fewer only at the end
+size_t aht20_rec_reader_read(aht20_rec_reader *reader, struct aht20_rec_sample *samples, size_t n);
+void aht20_rec_reader_close(aht20_rec_reader *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AHT20_REC_H
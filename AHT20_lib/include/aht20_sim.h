@@ -0,0 +1,257 @@
+#ifndef AHT20_SIM_H
+#define AHT20_SIM_H
+
+// Software AHT20 shared by the kernel adapter (DO_AN_AHT20/aht20_sim.c) and
+// libaht20's sim transport: the 0x71/0xBE/0xAC/0xBA state machine with a
+// busy bit for the length of a conversion, scripted waveforms and fault
+// injection. Freestanding like aht20_proto.h; callers pass the time in.
+
+#include "aht20_proto.h"
+
+#ifdef __KERNEL__
+#include <linux/math64.h>
+#define AHT20_SIM_DIV(n, d) div_s64((n), (d))
+#define AHT20_SIM_DIVU(n, d) div_u64((n), (d))
+#else
+#define AHT20_SIM_DIV(n, d) ((n) / (int64_t)(d))
+#define AHT20_SIM_DIVU(n, d) ((n) / (uint64_t)(d))
+#endif
+
+// Waveform shapes. Values are milli-degC or milli-%RH.
+#define AHT20_SIM_CONST 0       // base
+#define AHT20_SIM_TRIANGLE 1    // base - amplitude .. base + amplitude and back
+#define AHT20_SIM_SQUARE 2      // base + amplitude, then base - amplitude
+#define AHT20_SIM_SCRIPT 3      // piecewise linear over points[], repeating
+
+struct aht20_sim_point {
+    uint32_t t_ms;              // ascending, first one 0
+    int32_t value;
+};
+
+struct aht20_sim_wave {
+    int shape;
+    int32_t base;
+    int32_t amplitude;
+    uint32_t period_ms;
+    const struct aht20_sim_point *points;
+    uint32_t npoints;
+};
+
+struct aht20_sim_config {
+    uint32_t conversion_us;     // busy time after 0xAC
+    uint32_t crc_error_ppm;     // frames with a corrupted CRC, per million
+    uint32_t nak_ppm;           // messages NAKed, per million
+    uint32_t seed;
+    struct aht20_sim_wave temperature;
+    struct aht20_sim_wave humidity;
+};
+
+struct aht20_sim_stats {
+    uint64_t triggers;
+    uint64_t frames;            // reads of the full 7 bytes
+    uint64_t busy_frames;
+    uint64_t crc_errors;        // frames sent with a bad CRC
+    uint64_t naks;
+    uint64_t inits;
+    uint64_t resets;
+};
+
+struct aht20_sim {
+    struct aht20_sim_config cfg;
+    struct aht20_sim_stats stats;
+    uint32_t rng;
+    uint8_t status;
+    uint64_t start_us;          // time zero of the waveforms
+    uint64_t ready_us;          // end of the running conversion
+    uint32_t raw_temperature;
+    uint32_t raw_humidity;
+};
+
+// Datasheet timing, 25.0 C and 50.0 %RH
+static inline void aht20_sim_defaults(struct aht20_sim_config *cfg)
+{
+    struct aht20_sim_config zero = {};
+
+    *cfg = zero;
+    cfg->conversion_us = 80000;
+    cfg->seed = 1;
+    cfg->temperature.base = 25000;
+    cfg->humidity.base = 50000;
+}
+
+// Powers up uncalibrated, like a sensor that still needs 0xBE
+static inline void aht20_sim_init(struct aht20_sim *sim, const struct aht20_sim_config *cfg,
+                                  uint64_t now_us)
+{
+    struct aht20_sim zero = {};
+
+    *sim = zero;
+    sim->cfg = *cfg;
+    sim->rng = cfg->seed ? cfg->seed : 1;
+    sim->start_us = now_us;
+}
+
+// xorshift32
+static inline uint32_t aht20_sim_rand(struct aht20_sim *sim)
+{
+    uint32_t x = sim->rng;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sim->rng = x;
+    return x;
+}
+
+static inline int aht20_sim_chance(struct aht20_sim *sim, uint32_t ppm)
+{
+    return ppm && aht20_sim_rand(sim) % 1000000 < ppm;
+}
+
+static inline int32_t aht20_sim_wave_eval(const struct aht20_sim_wave *w, uint32_t t_ms)
+{
+    uint32_t phase, half;
+    uint32_t i;
+
+    switch (w->shape) {
+    case AHT20_SIM_TRIANGLE:
+        if (!w->period_ms)
+            return w->base;
+        half = w->period_ms / 2 ? w->period_ms / 2 : 1;
+        phase = t_ms % w->period_ms;
+        if (phase >= half)
+            phase = w->period_ms - phase;
+        return w->base - w->amplitude +
+               (int32_t)AHT20_SIM_DIV((int64_t)2 * w->amplitude * phase, half);
+    case AHT20_SIM_SQUARE:
+        if (!w->period_ms)
+            return w->base;
+        phase = t_ms % w->period_ms;
+        return phase < w->period_ms / 2 ? w->base + w->amplitude : w->base - w->amplitude;
+    case AHT20_SIM_SCRIPT:
+        if (!w->npoints)
+            return w->base;
+        if (w->npoints == 1 || !w->points[w->npoints - 1].t_ms)
+            return w->points[0].value;
+        phase = t_ms % w->points[w->npoints - 1].t_ms;
+        for (i = 1; i < w->npoints; i++) {
+            const struct aht20_sim_point *a = &w->points[i - 1];
+            const struct aht20_sim_point *b = &w->points[i];
+
+            if (phase < b->t_ms) {
+                if (b->t_ms == a->t_ms)
+                    return b->value;
+                return a->value + (int32_t)AHT20_SIM_DIV((int64_t)(b->value - a->value) *
+                                                         (phase - a->t_ms), b->t_ms - a->t_ms);
+            }
+        }
+        return w->points[w->npoints - 1].value;
+    default:
+        return w->base;
+    }
+}
+
+// Inverse of aht20_temp_milli()/aht20_hum_milli(), clamped to the sensor range.
+// 200000 * 2^14 and 100000 * 2^15 both fit 32 bits.
+static inline uint32_t aht20_sim_raw_temperature(int32_t milli)
+{
+    uint32_t raw;
+
+    if (milli < -50000)
+        milli = -50000;
+    if (milli > 150000)
+        milli = 150000;
+    raw = (uint32_t)(milli + 50000) * 16384 / 3125;
+    return raw > 0xFFFFF ? 0xFFFFF : raw;
+}
+
+static inline uint32_t aht20_sim_raw_humidity(int32_t milli)
+{
+    uint32_t raw;
+
+    if (milli < 0)
+        milli = 0;
+    if (milli > 100000)
+        milli = 100000;
+    raw = (uint32_t)milli * 32768 / 3125;
+    return raw > 0xFFFFF ? 0xFFFFF : raw;
+}
+
+// Finish the running conversion once its time is up, latching the
+// waveforms at the moment it completed
+static inline void aht20_sim_update(struct aht20_sim *sim, uint64_t now_us)
+{
+    uint32_t t_ms;
+
+    if (!(sim->status & AHT20_STATUS_BUSY) || now_us < sim->ready_us)
+        return;
+
+    t_ms = (uint32_t)AHT20_SIM_DIVU(sim->ready_us - sim->start_us, 1000);
+    sim->raw_temperature = aht20_sim_raw_temperature(aht20_sim_wave_eval(&sim->cfg.temperature, t_ms));
+    sim->raw_humidity = aht20_sim_raw_humidity(aht20_sim_wave_eval(&sim->cfg.humidity, t_ms));
+    sim->status &= ~AHT20_STATUS_BUSY;
+}
+
+// Decide whether the next message on the bus is NAKed
+static inline int aht20_sim_nak(struct aht20_sim *sim)
+{
+    if (!aht20_sim_chance(sim, sim->cfg.nak_ppm))
+        return 0;
+    sim->stats.naks++;
+    return 1;
+}
+
+static inline void aht20_sim_write(struct aht20_sim *sim, const uint8_t *buf, uint32_t len,
+                                   uint64_t now_us)
+{
+    if (!len)
+        return;
+
+    aht20_sim_update(sim, now_us);
+    switch (buf[0]) {
+    case AHT20_CMD_INIT:
+        sim->status |= AHT20_STATUS_CALIBRATED;
+        sim->stats.inits++;
+        break;
+    case AHT20_CMD_MEASURE:
+        // A trigger while busy is ignored, as on the real part
+        if (!(sim->status & AHT20_STATUS_BUSY)) {
+            sim->status |= AHT20_STATUS_BUSY;
+            sim->ready_us = now_us + sim->cfg.conversion_us;
+            sim->stats.triggers++;
+        }
+        break;
+    case AHT20_CMD_SOFT_RESET:
+        sim->status = 0;
+        sim->stats.resets++;
+        break;
+    default:
+        break;                  // 0x71 and anything else: next read is the status
+    }
+}
+
+// Any read starts with the status byte; 7 bytes is the whole frame
+static inline void aht20_sim_read(struct aht20_sim *sim, uint8_t *buf, uint32_t len,
+                                  uint64_t now_us)
+{
+    uint8_t frame[AHT20_FRAME_LEN];
+    uint32_t i;
+
+    aht20_sim_update(sim, now_us);
+    aht20_encode_frame(frame, sim->status, sim->raw_humidity, sim->raw_temperature);
+
+    if (len >= AHT20_FRAME_LEN) {
+        sim->stats.frames++;
+        if (sim->status & AHT20_STATUS_BUSY) {
+            sim->stats.busy_frames++;
+        } else if (aht20_sim_chance(sim, sim->cfg.crc_error_ppm)) {
+            frame[6] ^= 1 << (aht20_sim_rand(sim) & 7);
+            sim->stats.crc_errors++;
+        }
+    }
+
+    for (i = 0; i < len; i++)
+        buf[i] = i < AHT20_FRAME_LEN ? frame[i] : 0xFF;
+}
+
+#endif // AHT20_SIM_H
@@ -0,0 +1,73 @@
+#ifndef AHT20_TRANSPORT_H
+#define AHT20_TRANSPORT_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Pluggable I2C transport for libaht20. A backend runs a list of messages
+// as one combined transaction (repeated start between messages), so the
+// status probe is one call and a trigger or a fetch is one call each.
+
+#define AHT20_MSG_READ 0x0001
+
+struct aht20_msg {
+    uint16_t addr;
+    uint16_t flags;             // AHT20_MSG_READ or 0 for a write
+    uint16_t len;
+    uint8_t *buf;
+};
+
+struct aht20_transport;
+
+struct aht20_transport_ops {
+    // 0 on success, -1 with errno set on failure (e.g. ENXIO for a NAK)
+    int (*xfer)(struct aht20_transport *t, struct aht20_msg *msgs, int n);
+    void (*close)(struct aht20_transport *t);
+};
+
+struct aht20_transport_stats {
+    uint64_t xfers;             // backend calls; one ioctl each for I2C_RDWR
+    uint64_t msgs;              // I2C messages on the bus
+    uint64_t errors;
+};
+
+struct aht20_transport {
+    const struct aht20_transport_ops *ops;
+    void *ctx;
+    int fd;                     // -1 for backends without a file descriptor
+    int flags;
+    struct aht20_transport_stats stats;
+};
+
+// I2C_RDWR backend on /dev/i2c-N. Falls back to write()/read() per message
+// on adapters without plain I2C support.
+struct aht20_transport *aht20_transport_i2c_open(const char *bus);
+// Same backend on an fd the caller keeps owning (the aht20_init() fd)
+void aht20_transport_i2c_wrap(struct aht20_transport *t, int file);
+
+// In-memory AHT20 at 0x38: answers 0x71/0xBE/0xAC at once with the values
+// set below. Writes to other addresses (muxes) are accepted, reads NAK.
+struct aht20_transport *aht20_transport_mem_open(void);
+void aht20_transport_mem_set(struct aht20_transport *t, uint32_t raw_humidity,
+                             uint32_t raw_temperature);
+
+// Simulated AHT20s (aht20_sim.h): one at 0x38 and one behind each channel
+// of muxes at 0x70-0x77. Busy for cfg->conversion_us after each trigger,
+// values from the configured waveforms, CRC corruption and NAKs at the
+// configured rates. NULL selects aht20_sim_defaults(). Stats are summed.
+struct aht20_sim_config;
+struct aht20_sim_stats;
+struct aht20_transport *aht20_transport_sim_open(const struct aht20_sim_config *cfg);
+int aht20_transport_sim_stats(const struct aht20_transport *t, struct aht20_sim_stats *stats);
+
+int aht20_transport_xfer(struct aht20_transport *t, struct aht20_msg *msgs, int n);
+void aht20_transport_close(struct aht20_transport *t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AHT20_TRANSPORT_H
@@ -0,0 +1,117 @@
+#ifndef AHT20D_H
+#define AHT20D_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Protocol of aht20d (tools/aht20d.c), the daemon that owns the sensors and
+// samples each one once per period however many clients there are.
+//
+// Clients talk to it over a SOCK_SEQPACKET Unix socket: one struct
+// aht20d_request per packet in, one struct aht20d_message per packet out.
+//   AHT20D_REQ_INFO       -> AHT20D_MSG_INFO
+//   AHT20D_REQ_QUERY      -> AHT20D_MSG_SAMPLE, the latest sample of sensor
+//                            (waits for the first one after startup)
+//   AHT20D_REQ_SUBSCRIBE  -> AHT20D_MSG_SAMPLE for every new sample of the
+//                            sensors in mask, until AHT20D_REQ_UNSUBSCRIBE.
+//                            A subscriber that does not keep up loses samples.
+// Bad requests get AHT20D_MSG_ERROR.
+//
+// With --shm the daemon also publishes every sample to a POSIX shared memory
+// object: struct aht20d_shm, one seqlock slot per sensor. aht20d_shm_read()
+// copies a slot with no system call.
+
+#define AHT20D_SOCKET "/run/aht20d.sock"
+#define AHT20D_MAX_SENSORS 64
+
+#define AHT20D_REQ_INFO 1
+#define AHT20D_REQ_QUERY 2
+#define AHT20D_REQ_SUBSCRIBE 3
+#define AHT20D_REQ_UNSUBSCRIBE 4
+
+#define AHT20D_MSG_INFO 1
+#define AHT20D_MSG_SAMPLE 2
+#define AHT20D_MSG_ERROR 3
+
+struct aht20d_request {
+    uint32_t type;              // AHT20D_REQ_*
+    uint32_t sensor;            // QUERY
+    uint64_t mask;              // SUBSCRIBE/UNSUBSCRIBE: bit n = sensor n
+};
+
+struct aht20d_sample {
+    uint32_t sensor;
+    int32_t error;              // 0, or the errno of a failed reading (values are stale)
+    uint64_t seq;               // readings of this sensor so far, failed ones included
+    int64_t timestamp_ns;       // CLOCK_MONOTONIC when the frame was read
+    int32_t temperature;        // 0.1 C
+    uint32_t humidity;          // 0.1 %RH
+};
+
+struct aht20d_info {
+    uint32_t nsensors;
+    uint32_t period_ms;
+    char shm_name[32];          // empty without --shm
+};
+
+struct aht20d_message {
+    uint32_t type;              // AHT20D_MSG_*
+    int32_t error;              // MSG_ERROR: errno value
+    union {
+        struct aht20d_sample sample;
+        struct aht20d_info info;
+    };
+};
+
+// Shared memory layout. lock_seq is odd while the daemon writes the slot.
+#define AHT20D_SHM_MAGIC 0x44303241     // "A20D"
+
+struct aht20d_shm_slot {
+    uint32_t lock_seq __attribute__((aligned(64)));
+    uint32_t pad;
+    struct aht20d_sample sample;
+};
+
+struct aht20d_shm {
+    uint32_t magic;
+    uint32_t nsensors;
+    uint32_t period_ms;
+    uint32_t pad;
+    struct aht20d_shm_slot slots[AHT20D_MAX_SENSORS];
+};
+
+static inline void aht20d_shm_read(const struct aht20d_shm *shm, uint32_t sensor,
+                                   struct aht20d_sample *out)
+{
+    const struct aht20d_shm_slot *slot = &shm->slots[sensor];
+    uint32_t begin, end;
+
+    do {
+        begin = __atomic_load_n(&slot->lock_seq, __ATOMIC_ACQUIRE);
+        *out = slot->sample;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        end = __atomic_load_n(&slot->lock_seq, __ATOMIC_RELAXED);
+    } while ((begin & 1) || begin != end);
+}
+
+// Client side, in libaht20. Functions returning int give 0 or -1 with errno.
+// path = NULL means AHT20D_SOCKET.
+int aht20d_connect(const char *path);
+int aht20d_info(int fd, struct aht20d_info *info);
+int aht20d_query(int fd, uint32_t sensor, struct aht20d_sample *sample);
+int aht20d_subscribe(int fd, uint64_t mask);
+int aht20d_unsubscribe(int fd, uint64_t mask);
+// Next streamed sample, blocking unless fd is non-blocking
+int aht20d_next(int fd, struct aht20d_sample *sample);
+// Read-only mapping of the daemon's shared memory object
+const struct aht20d_shm *aht20d_shm_open(const char *name);
+void aht20d_shm_close(const struct aht20d_shm *shm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AHT20D_H
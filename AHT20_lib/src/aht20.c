@@ -2,24 +2,13 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <sys/ioctl.h>
+#include <time.h>
+#include <sys/timerfd.h>
 #include <linux/i2c-dev.h>
 #include "aht20.h"
-
-static uint8_t crc8(const uint8_t *data, int len) {
-    uint8_t crc = 0xFF;
-    for (int i = 0; i < len; i++) {
-        crc ^= data[i];
-        for (int j = 0; j < 8; j++) {
-            if (crc & 0x80) {
-                crc = (crc << 1) ^ 0x31;
-            } else {
-                crc <<= 1;
-            }
-        }
-    }
-    return crc;
-}
+#include "aht20_internal.h"
 
 int aht20_init(int *file) {
     *file = open(I2C_DEVICE, O_RDWR);
@@ -37,135 +26,362 @@ int aht20_init(int *file) {
     return 0;
 }
 
-int aht20_read_temperature(int file, uint32_t *temperature) {
-    uint8_t cmd[3];
-    uint8_t buf[7];
-    uint8_t crc;
-    int tem;
-
-    // Step 1: Check sensor status
-    cmd[0] = AHT20_CMD_STATUS;
-    if (write(file, cmd, 1) != 1) {
-        perror("Failed to send status command");
-        return -1;
-    }
+static int aht20_arm(int ready_fd, long usec) {
+    struct itimerspec its = {0};
 
-    usleep(20000);
+    its.it_value.tv_sec = usec / 1000000;
+    its.it_value.tv_nsec = (usec % 1000000) * 1000;
+    return timerfd_settime(ready_fd, 0, &its, NULL);
+}
 
-    if (read(file, buf, 1) != 1) {
-        perror("Failed to read status");
-        return -1;
-    }
+// Steps 1 and 2: status probe, init if needed, trigger. *calibrated caches
+// the probe result between calls; with NULL the status is always checked.
+int aht20_start_conversion(struct aht20_transport *t, int *calibrated) {
+    uint8_t cmd[3];
+    uint8_t status;
+    struct aht20_msg msgs[2];
 
-    if ((buf[0] & 0x18) != 0x18) {
-        // Sensor needs initialization
-        cmd[0] = AHT20_CMD_INIT;
-        cmd[1] = 0x08;
-        cmd[2] = 0x00;
-        if (write(file, cmd, 3) != 3) {
-            perror("Failed to initialize sensor");
+    if (!calibrated || !*calibrated) {
+        // Step 1: Check sensor status, write 0x71 + read 1 in one transaction
+        cmd[0] = AHT20_CMD_STATUS;
+        msgs[0] = (struct aht20_msg){ AHT20_ADDR, 0, 1, cmd };
+        msgs[1] = (struct aht20_msg){ AHT20_ADDR, AHT20_MSG_READ, 1, &status };
+        if (aht20_transport_xfer(t, msgs, 2) < 0) {
+            perror("Failed to read status");
             return -1;
         }
-        usleep(10000);
+
+        if ((status & AHT20_STATUS_CALIBRATED) != AHT20_STATUS_CALIBRATED) {
+            // Sensor needs initialization; only after power-up, so block here
+            cmd[0] = AHT20_CMD_INIT;
+            cmd[1] = 0x08;
+            cmd[2] = 0x00;
+            msgs[0] = (struct aht20_msg){ AHT20_ADDR, 0, 3, cmd };
+            if (aht20_transport_xfer(t, msgs, 1) < 0) {
+                perror("Failed to initialize sensor");
+                return -1;
+            }
+            usleep(AHT20_INIT_US);
+        }
+
+        if (calibrated) {
+            *calibrated = 1;
+        }
     }
 
     // Step 2: Trigger measurement
     cmd[0] = AHT20_CMD_MEASURE;
     cmd[1] = 0x33;
     cmd[2] = 0x00;
-    if (write(file, cmd, 3) != 3) {
+    msgs[0] = (struct aht20_msg){ AHT20_ADDR, 0, 3, cmd };
+    if (aht20_transport_xfer(t, msgs, 1) < 0) {
         perror("Failed to send measurement command");
         return -1;
     }
 
-    usleep(80000);
+    return 0;
+}
 
-    // Step 3: Read data
-    if (read(file, buf, 7) != 7) {
+// Step 3: Read data. Returns 1 while the sensor is still busy. A frame
+// without the calibrated bits clears *calibrated so the next start probes.
+// A CRC failure sets errno to EBADMSG.
+int aht20_read_frame(struct aht20_transport *t, int *calibrated, struct aht20_reading *r) {
+    uint8_t frame[AHT20_FRAME_LEN];
+    struct aht20_msg msg = { AHT20_ADDR, AHT20_MSG_READ, AHT20_FRAME_LEN, frame };
+
+    if (aht20_transport_xfer(t, &msg, 1) < 0) {
         perror("Failed to read data");
         return -1;
     }
 
-    if (buf[0] & 0x80) {
-        perror("Sensor is busy");
+    switch (aht20_decode_frame(frame, r)) {
+    case AHT20_FRAME_OK:
+        if (calibrated && (r->status & AHT20_STATUS_CALIBRATED) != AHT20_STATUS_CALIBRATED) {
+            *calibrated = 0;
+        }
+        return 0;
+    case AHT20_FRAME_BUSY:
+        return 1;
+    default:
+        fprintf(stderr, "CRC check failed\n");
+        errno = EBADMSG;
         return -1;
     }
+}
 
-    crc = crc8(buf, 6);
-    if (crc != buf[6]) {
-        perror("CRC check failed");
-        return -1;
+int64_t aht20_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void aht20_recovery_begin(struct aht20_recovery *rec) {
+    rec->deadline_ns = aht20_now_ns() + (int64_t)rec->deadline_ms * 1000000;
+    rec->faults = 0;
+    rec->reset = 0;
+    rec->pending = 0;
+    AHT20_STAT(rec, reads);
+}
+
+void aht20_recovery_end(struct aht20_recovery *rec, int ret) {
+    if (ret < 0) {
+        AHT20_STAT(rec, failures);
+    } else if (rec->faults) {
+        AHT20_STAT(rec, recovered);
     }
+}
 
-    tem = ((buf[3] & 0xF) << 16) | (buf[4] << 8) | buf[5];
-    *temperature = ((tem * 2000) / 0x100000) - 500;
-    
+// 0xBA restarts the sensor; the next conversion probes 0x71 and sends 0xBE
+static int aht20_soft_reset(struct aht20_transport *t, int *calibrated) {
+    uint8_t cmd = AHT20_CMD_SOFT_RESET;
+    struct aht20_msg msg = { AHT20_ADDR, 0, 1, &cmd };
+
+    if (calibrated) {
+        *calibrated = 0;
+    }
+    if (aht20_transport_xfer(t, &msg, 1) < 0) {
+        perror("Failed to send soft reset");
+        return -1;
+    }
     return 0;
 }
 
-int aht20_read_humidity(int file, uint32_t *humidity) {
-    uint8_t cmd[3];
-    uint8_t buf[7];
-    uint8_t crc;
-    int hum;
-
-    // Step 1: Check sensor status
-    cmd[0] = AHT20_CMD_STATUS;
-    if (write(file, cmd, 1) != 1) {
-        perror("Failed to send status command");
+// Called after a failed conversion, errno still set by it. Returns 0 with
+// the delay before the next conversion may start, or -1 to give up with
+// the original errno.
+int aht20_recover(struct aht20_transport *t, int *calibrated, struct aht20_recovery *rec,
+                  long *delay_us) {
+    int err = errno;
+    int64_t need_us = AHT20_CONVERSION_US;
+
+    if (err == EBADMSG) {
+        AHT20_STAT(rec, crc_errors);
+    } else if (err != ETIMEDOUT) {
+        AHT20_STAT(rec, i2c_errors);
+    }
+
+    rec->faults++;
+    if (rec->faults >= AHT20_RESET_AFTER) {
+        if (rec->reset) {
+            errno = err;
+            return -1;
+        }
+        need_us += AHT20_SOFT_RESET_US + AHT20_INIT_US;
+    }
+    if (aht20_now_ns() + need_us * 1000 > rec->deadline_ns) {
+        errno = err;
         return -1;
     }
 
-    usleep(20000);
+    if (rec->faults < AHT20_RESET_AFTER) {
+        AHT20_STAT(rec, retriggers);
+        *delay_us = 1;      // a timerfd armed with 0 would be disarmed
+        return 0;
+    }
+    rec->reset = 1;
+    if (aht20_soft_reset(t, calibrated) < 0) {
+        errno = err;
+        return -1;
+    }
+    AHT20_STAT(rec, soft_resets);
+    *delay_us = AHT20_SOFT_RESET_US;
+    return 0;
+}
+
+// One conversion, re-reading busy frames for up to AHT20_BUSY_RETRIES
+static int aht20_read_once(struct aht20_transport *t, int *calibrated, struct aht20_recovery *rec,
+                           struct aht20_reading *r) {
+    int ret;
 
-    if (read(file, buf, 1) != 1) {
-        perror("Failed to read status");
+    if (aht20_start_conversion(t, calibrated) < 0) {
         return -1;
     }
 
-    if ((buf[0] & 0x18) != 0x18) {
-        // Sensor needs initialization
-        cmd[0] = AHT20_CMD_INIT;
-        cmd[1] = 0x08;
-        cmd[2] = 0x00;
-        if (write(file, cmd, 3) != 3) {
-            perror("Failed to initialize sensor");
+    usleep(AHT20_CONVERSION_US);
+    for (int tries = 0; ; tries++) {
+        ret = aht20_read_frame(t, calibrated, r);
+        if (ret != 1) {
+            return ret;
+        }
+        if (tries >= AHT20_BUSY_RETRIES) {
+            fprintf(stderr, "Sensor is busy\n");
+            errno = ETIMEDOUT;
             return -1;
         }
-        usleep(10000);
+        AHT20_STAT(rec, busy_refetches);
+        usleep(AHT20_BUSY_RETRY_US);
     }
+}
 
-    // Step 2: Trigger measurement
-    cmd[0] = AHT20_CMD_MEASURE;
-    cmd[1] = 0x33;
-    cmd[2] = 0x00;
-    if (write(file, cmd, 3) != 3) {
-        perror("Failed to send measurement command");
+// One conversion, both channels, blocking, with recovery
+int aht20_read_reading(struct aht20_transport *t, int *calibrated, struct aht20_recovery *rec,
+                       struct aht20_reading *r) {
+    struct aht20_recovery local = { .deadline_ms = AHT20_RECOVERY_DEFAULT_MS };
+    long delay_us;
+    int ret;
+
+    if (!rec) {
+        rec = &local;
+    }
+    aht20_recovery_begin(rec);
+    for (;;) {
+        ret = aht20_read_once(t, calibrated, rec, r);
+        if (ret == 0 || aht20_recover(t, calibrated, rec, &delay_us) < 0) {
+            break;
+        }
+        usleep(delay_us);
+    }
+    aht20_recovery_end(rec, ret);
+    return ret;
+}
+
+// Start a conversion and return a timerfd that fires when it should be done
+int aht20_trigger_transport(struct aht20_transport *t, int *calibrated, struct aht20_recovery *rec) {
+    long delay_us;
+    int ready_fd;
+
+    ready_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (ready_fd < 0) {
+        perror("Failed to create timerfd");
         return -1;
     }
 
-    usleep(80000);
+    if (rec) {
+        aht20_recovery_begin(rec);
+    }
+    delay_us = AHT20_CONVERSION_US;
+    if (aht20_start_conversion(t, calibrated) < 0) {
+        // A NAKed trigger is retried from aht20_fetch_transport()
+        if (!rec || aht20_recover(t, calibrated, rec, &delay_us) < 0) {
+            if (rec) {
+                aht20_recovery_end(rec, -1);
+            }
+            close(ready_fd);
+            return -1;
+        }
+        rec->pending = 1;
+    }
 
-    // Step 3: Read data
-    if (read(file, buf, 7) != 7) {
-        perror("Failed to read data");
+    // fd fires when the conversion should be done
+    if (aht20_arm(ready_fd, delay_us) < 0) {
+        perror("Failed to arm timerfd");
+        if (rec) {
+            aht20_recovery_end(rec, -1);
+        }
+        close(ready_fd);
         return -1;
     }
 
-    if (buf[0] & 0x80) {
-        perror("Sensor is busy");
+    return ready_fd;
+}
+
+// With rec, returns 1 and re-arms ready_fd while the sensor is busy, until
+// the deadline; without, a busy frame fails with ETIMEDOUT. With rec, a
+// fault also returns 1: ready_fd then fires when the retry (after a soft
+// reset if needed) may start, and that fetch starts its conversion.
+int aht20_fetch_transport(struct aht20_transport *t, int *calibrated, struct aht20_recovery *rec,
+                          int ready_fd, struct aht20_reading *r) {
+    uint64_t expirations;
+    long delay_us;
+    int ret;
+
+    // Drain the timer so level-triggered pollers do not spin
+    if (read(ready_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+        perror("Failed to read timerfd");
+    }
+
+    if (rec && rec->pending) {
+        rec->pending = 0;
+        ret = aht20_start_conversion(t, calibrated) < 0 ? -1 : 1;
+        delay_us = AHT20_CONVERSION_US;
+    } else {
+        ret = aht20_read_frame(t, calibrated, r);
+        delay_us = AHT20_BUSY_RETRY_US;
+        if (ret == 1 && rec) {
+            AHT20_STAT(rec, busy_refetches);
+            if (aht20_now_ns() > rec->deadline_ns) {
+                fprintf(stderr, "Sensor is busy\n");
+                errno = ETIMEDOUT;
+                ret = -1;
+            }
+        } else if (ret == 1) {
+            // A raw fd keeps no state to bound re-arms with
+            fprintf(stderr, "Sensor is busy\n");
+            errno = ETIMEDOUT;
+            ret = -1;
+        }
+    }
+    if (ret < 0 && rec && aht20_recover(t, calibrated, rec, &delay_us) == 0) {
+        rec->pending = 1;
+        ret = 1;
+    }
+
+    if (ret == 1) {
+        if (aht20_arm(ready_fd, delay_us) == 0) {
+            return 1;
+        }
+        perror("Failed to arm timerfd");
+        ret = -1;
+    }
+
+    if (rec) {
+        aht20_recovery_end(rec, ret);
+    }
+    close(ready_fd);
+    return ret;
+}
+
+int aht20_trigger(int file) {
+    struct aht20_transport t;
+
+    aht20_transport_i2c_wrap(&t, file);
+    return aht20_trigger_transport(&t, NULL, NULL);
+}
+
+int aht20_fetch(int file, int ready_fd, uint32_t *temperature, uint32_t *humidity) {
+    struct aht20_transport t;
+    struct aht20_reading r;
+    int ret;
+
+    aht20_transport_i2c_wrap(&t, file);
+    ret = aht20_fetch_transport(&t, NULL, NULL, ready_fd, &r);
+    if (ret != 0) {
+        return ret;
+    }
+
+    if (temperature) {
+        *temperature = r.temperature;
+    }
+    if (humidity) {
+        *humidity = r.humidity;
+    }
+    return 0;
+}
+
+int aht20_read_temperature(int file, uint32_t *temperature) {
+    struct aht20_transport t;
+    struct aht20_reading r;
+
+    aht20_transport_i2c_wrap(&t, file);
+    if (aht20_read_reading(&t, NULL, NULL, &r) < 0) {
         return -1;
     }
 
-    crc = crc8(buf, 6);
-    if (crc != buf[6]) {
-        perror("CRC check failed");
+    *temperature = r.temperature;
+    return 0;
+}
+
+int aht20_read_humidity(int file, uint32_t *humidity) {
+    struct aht20_transport t;
+    struct aht20_reading r;
+
+    aht20_transport_i2c_wrap(&t, file);
+    if (aht20_read_reading(&t, NULL, NULL, &r) < 0) {
         return -1;
     }
 
-    hum = (buf[1] << 12) | (buf[2] << 4) | (buf[3] >> 4);
-    *humidity = ((hum * 1000) / 0x100000);
-    
+    *humidity = r.humidity;
     return 0;
 }
 
@@ -0,0 +1,457 @@
+#include <errno.h>
+#include <pthread.h>
+#include "aht20_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AHT20_DECODE_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define AHT20_DECODE_ARM64 1
+#endif
+
+// SIMD kernels decode 16 frames (32 for AVX2) at a time:
+// - every 16-byte load at frame 2k holds frames 2k and 2k+1; a byte shuffle
+//   pairs their bytes into 16-bit words and an 8x8 transpose of those words
+//   gives one vector per frame byte, lane j = frame j
+// - the CRC has no init value once the constant for 0xFF is split off, so it
+//   is linear: per byte position, two 16-entry nibble tables in registers
+// - fields are widened to 32 bits; * 125 is (x << 7) - (x << 2) + x
+// The last load of a block reads 2 bytes past it, so blocks stop one frame
+// before the end and the scalar loop does the rest.
+
+typedef size_t (*aht20_decode_fn)(const uint8_t *frames, size_t n, int32_t *temperature,
+                                  uint32_t *humidity, uint8_t *status);
+
+// crc_lo[p][v]/crc_hi[p][v]: CRC contribution of nibble v in the low/high
+// half of byte p (0..5), init value excluded
+static uint8_t crc_lo[6][16] __attribute__((aligned(16)));
+static uint8_t crc_hi[6][16] __attribute__((aligned(16)));
+static uint8_t crc_init;       // CRC of six zero bytes, i.e. the 0xFF init alone
+
+static pthread_once_t decode_once = PTHREAD_ONCE_INIT;
+static aht20_decode_fn decode_fn;
+static int decode_kernel;
+
+static size_t decode_scalar(const uint8_t *frames, size_t n, int32_t *temperature,
+                            uint32_t *humidity, uint8_t *status) {
+    size_t ok = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        struct aht20_reading r;
+
+        status[i] = aht20_decode_frame(frames + i * AHT20_FRAME_LEN, &r);
+        if (status[i] == AHT20_FRAME_OK) {
+            temperature[i] = r.temperature;
+            humidity[i] = r.humidity;
+            ok++;
+        } else {
+            temperature[i] = 0;
+            humidity[i] = 0;
+        }
+    }
+    return ok;
+}
+
+#ifdef AHT20_DECODE_X86
+
+// Transposed frame bytes of one block: b[p] lane j = byte p of frame j
+struct sse_block {
+    __m128i b[7];
+};
+
+__attribute__((target("ssse3")))
+static inline void sse_load(const uint8_t *f, struct sse_block *blk) {
+    const __m128i pair = _mm_setr_epi8(0, 7, 1, 8, 2, 9, 3, 10, 4, 11, 5, 12, 6, 13, -1, -1);
+    __m128i x[8], a[8], b[8];
+
+    for (int k = 0; k < 8; k++) {
+        x[k] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(f + 14 * k)), pair);
+    }
+    for (int k = 0; k < 8; k += 2) {
+        a[k] = _mm_unpacklo_epi16(x[k], x[k + 1]);
+        a[k + 1] = _mm_unpackhi_epi16(x[k], x[k + 1]);
+    }
+    for (int k = 0; k < 8; k += 4) {
+        b[k] = _mm_unpacklo_epi32(a[k], a[k + 2]);
+        b[k + 1] = _mm_unpackhi_epi32(a[k], a[k + 2]);
+        b[k + 2] = _mm_unpacklo_epi32(a[k + 1], a[k + 3]);
+        b[k + 3] = _mm_unpackhi_epi32(a[k + 1], a[k + 3]);
+    }
+    for (int k = 0; k < 4; k++) {
+        blk->b[2 * k] = _mm_unpacklo_epi64(b[k], b[k + 4]);
+        if (k < 3) {
+            blk->b[2 * k + 1] = _mm_unpackhi_epi64(b[k], b[k + 4]);
+        }
+    }
+}
+
+// 32-bit results for 4 frames: w12 = byte1:byte2, w3 = byte3, w45 = byte4:byte5
+__attribute__((target("ssse3")))
+static inline void sse_convert(__m128i w12, __m128i w3, __m128i w45, __m128i ok,
+                               int32_t *temperature, uint32_t *humidity) {
+    __m128i hum = _mm_or_si128(_mm_slli_epi32(w12, 4), _mm_srli_epi32(w3, 4));
+    __m128i tem = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(w3, _mm_set1_epi32(0xF)), 16), w45);
+
+    tem = _mm_add_epi32(_mm_sub_epi32(_mm_slli_epi32(tem, 7), _mm_slli_epi32(tem, 2)), tem);
+    hum = _mm_add_epi32(_mm_sub_epi32(_mm_slli_epi32(hum, 7), _mm_slli_epi32(hum, 2)), hum);
+    tem = _mm_sub_epi32(_mm_srli_epi32(tem, 16), _mm_set1_epi32(500));
+    hum = _mm_srli_epi32(hum, 17);
+    _mm_storeu_si128((__m128i *)temperature, _mm_and_si128(tem, ok));
+    _mm_storeu_si128((__m128i *)humidity, _mm_and_si128(hum, ok));
+}
+
+__attribute__((target("ssse3")))
+static size_t decode_ssse3(const uint8_t *frames, size_t n, int32_t *temperature,
+                           uint32_t *humidity, uint8_t *status) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    __m128i lo[6], hi[6];
+    size_t ok = 0, i;
+
+    for (int p = 0; p < 6; p++) {
+        lo[p] = _mm_load_si128((const __m128i *)crc_lo[p]);
+        hi[p] = _mm_load_si128((const __m128i *)crc_hi[p]);
+    }
+
+    for (i = 0; i + 17 <= n; i += 16) {
+        struct sse_block blk;
+        __m128i crc = _mm_set1_epi8((char)crc_init);
+        __m128i busy, good, st;
+
+        sse_load(frames + i * AHT20_FRAME_LEN, &blk);
+        for (int p = 0; p < 6; p++) {
+            __m128i v = blk.b[p];
+
+            crc = _mm_xor_si128(crc, _mm_shuffle_epi8(lo[p], _mm_and_si128(v, nibble)));
+            crc = _mm_xor_si128(crc, _mm_shuffle_epi8(hi[p],
+                                     _mm_and_si128(_mm_srli_epi16(v, 4), nibble)));
+        }
+        busy = _mm_cmplt_epi8(blk.b[0], zero);
+        good = _mm_cmpeq_epi8(crc, blk.b[6]);
+        st = _mm_or_si128(_mm_and_si128(busy, _mm_set1_epi8(AHT20_FRAME_BUSY)),
+                          _mm_andnot_si128(busy, _mm_andnot_si128(good, _mm_set1_epi8(AHT20_FRAME_CRC))));
+        _mm_storeu_si128((__m128i *)(status + i), st);
+        good = _mm_andnot_si128(busy, good);
+        ok += __builtin_popcount(_mm_movemask_epi8(good));
+
+        for (int h = 0; h < 2; h++) {
+            __m128i w12 = h ? _mm_unpackhi_epi8(blk.b[2], blk.b[1]) : _mm_unpacklo_epi8(blk.b[2], blk.b[1]);
+            __m128i w3 = h ? _mm_unpackhi_epi8(blk.b[3], zero) : _mm_unpacklo_epi8(blk.b[3], zero);
+            __m128i w45 = h ? _mm_unpackhi_epi8(blk.b[5], blk.b[4]) : _mm_unpacklo_epi8(blk.b[5], blk.b[4]);
+            __m128i g = h ? _mm_unpackhi_epi8(good, good) : _mm_unpacklo_epi8(good, good);
+            size_t j = i + 8 * h;
+
+            sse_convert(_mm_unpacklo_epi16(w12, zero), _mm_unpacklo_epi16(w3, zero),
+                        _mm_unpacklo_epi16(w45, zero), _mm_unpacklo_epi16(g, g),
+                        temperature + j, humidity + j);
+            sse_convert(_mm_unpackhi_epi16(w12, zero), _mm_unpackhi_epi16(w3, zero),
+                        _mm_unpackhi_epi16(w45, zero), _mm_unpackhi_epi16(g, g),
+                        temperature + j + 4, humidity + j + 4);
+        }
+    }
+    return ok + decode_scalar(frames + i * AHT20_FRAME_LEN, n - i, temperature + i,
+                              humidity + i, status + i);
+}
+
+// Same steps on 32 frames: lane 0 of every register holds frames 0..15 and
+// lane 1 frames 16..31, since AVX2 shuffles and unpacks stay within lanes
+struct avx2_block {
+    __m256i b[7];
+};
+
+__attribute__((target("avx2")))
+static inline void avx2_load(const uint8_t *f, struct avx2_block *blk) {
+    const __m256i pair = _mm256_setr_epi8(0, 7, 1, 8, 2, 9, 3, 10, 4, 11, 5, 12, 6, 13, -1, -1,
+                                          0, 7, 1, 8, 2, 9, 3, 10, 4, 11, 5, 12, 6, 13, -1, -1);
+    __m256i x[8], a[8], b[8];
+
+    for (int k = 0; k < 8; k++) {
+        x[k] = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(f + 14 * k))),
+            _mm_loadu_si128((const __m128i *)(f + 16 * AHT20_FRAME_LEN + 14 * k)), 1);
+        x[k] = _mm256_shuffle_epi8(x[k], pair);
+    }
+    for (int k = 0; k < 8; k += 2) {
+        a[k] = _mm256_unpacklo_epi16(x[k], x[k + 1]);
+        a[k + 1] = _mm256_unpackhi_epi16(x[k], x[k + 1]);
+    }
+    for (int k = 0; k < 8; k += 4) {
+        b[k] = _mm256_unpacklo_epi32(a[k], a[k + 2]);
+        b[k + 1] = _mm256_unpackhi_epi32(a[k], a[k + 2]);
+        b[k + 2] = _mm256_unpacklo_epi32(a[k + 1], a[k + 3]);
+        b[k + 3] = _mm256_unpackhi_epi32(a[k + 1], a[k + 3]);
+    }
+    for (int k = 0; k < 4; k++) {
+        blk->b[2 * k] = _mm256_unpacklo_epi64(b[k], b[k + 4]);
+        if (k < 3) {
+            blk->b[2 * k + 1] = _mm256_unpackhi_epi64(b[k], b[k + 4]);
+        }
+    }
+}
+
+// x * 125 for x < 2^20
+__attribute__((target("avx2")))
+static inline __m256i avx2_scale(__m256i x) {
+    return _mm256_add_epi32(_mm256_sub_epi32(_mm256_slli_epi32(x, 7), _mm256_slli_epi32(x, 2)), x);
+}
+
+__attribute__((target("avx2")))
+static size_t decode_avx2(const uint8_t *frames, size_t n, int32_t *temperature,
+                          uint32_t *humidity, uint8_t *status) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    __m256i lo[6], hi[6];
+    size_t ok = 0, i;
+
+    for (int p = 0; p < 6; p++) {
+        lo[p] = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)crc_lo[p]));
+        hi[p] = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)crc_hi[p]));
+    }
+
+    for (i = 0; i + 33 <= n; i += 32) {
+        struct avx2_block blk;
+        __m256i crc = _mm256_set1_epi8((char)crc_init);
+        __m256i busy, good, st;
+        __m256i tem[4], hum[4];
+
+        avx2_load(frames + i * AHT20_FRAME_LEN, &blk);
+        for (int p = 0; p < 6; p++) {
+            __m256i v = blk.b[p];
+
+            crc = _mm256_xor_si256(crc, _mm256_shuffle_epi8(lo[p], _mm256_and_si256(v, nibble)));
+            crc = _mm256_xor_si256(crc, _mm256_shuffle_epi8(hi[p],
+                                        _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble)));
+        }
+        busy = _mm256_cmpgt_epi8(zero, blk.b[0]);
+        good = _mm256_cmpeq_epi8(crc, blk.b[6]);
+        st = _mm256_or_si256(_mm256_and_si256(busy, _mm256_set1_epi8(AHT20_FRAME_BUSY)),
+                             _mm256_andnot_si256(busy, _mm256_andnot_si256(good,
+                                                 _mm256_set1_epi8(AHT20_FRAME_CRC))));
+        _mm256_storeu_si256((__m256i *)(status + i), st);
+        good = _mm256_andnot_si256(busy, good);
+        ok += __builtin_popcount((uint32_t)_mm256_movemask_epi8(good));
+
+        // q = 0..3: frames 4q..4q+3 in lane 0, 16+4q.. in lane 1
+        for (int h = 0; h < 2; h++) {
+            __m256i w12 = h ? _mm256_unpackhi_epi8(blk.b[2], blk.b[1]) : _mm256_unpacklo_epi8(blk.b[2], blk.b[1]);
+            __m256i w3 = h ? _mm256_unpackhi_epi8(blk.b[3], zero) : _mm256_unpacklo_epi8(blk.b[3], zero);
+            __m256i w45 = h ? _mm256_unpackhi_epi8(blk.b[5], blk.b[4]) : _mm256_unpacklo_epi8(blk.b[5], blk.b[4]);
+            __m256i g = h ? _mm256_unpackhi_epi8(good, good) : _mm256_unpacklo_epi8(good, good);
+
+            for (int q = 0; q < 2; q++) {
+                __m256i u12 = q ? _mm256_unpackhi_epi16(w12, zero) : _mm256_unpacklo_epi16(w12, zero);
+                __m256i u3 = q ? _mm256_unpackhi_epi16(w3, zero) : _mm256_unpacklo_epi16(w3, zero);
+                __m256i u45 = q ? _mm256_unpackhi_epi16(w45, zero) : _mm256_unpacklo_epi16(w45, zero);
+                __m256i m = q ? _mm256_unpackhi_epi16(g, g) : _mm256_unpacklo_epi16(g, g);
+                __m256i t, r;
+
+                r = _mm256_or_si256(_mm256_slli_epi32(u12, 4), _mm256_srli_epi32(u3, 4));
+                t = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(u3, _mm256_set1_epi32(0xF)), 16), u45);
+                t = _mm256_sub_epi32(_mm256_srli_epi32(avx2_scale(t), 16), _mm256_set1_epi32(500));
+                r = _mm256_srli_epi32(avx2_scale(r), 17);
+                tem[2 * h + q] = _mm256_and_si256(t, m);
+                hum[2 * h + q] = _mm256_and_si256(r, m);
+            }
+        }
+        for (int h = 0; h < 2; h++) {
+            int32_t *t = temperature + i + 8 * h;
+            uint32_t *r = humidity + i + 8 * h;
+
+            _mm256_storeu_si256((__m256i *)t, _mm256_permute2x128_si256(tem[2 * h], tem[2 * h + 1], 0x20));
+            _mm256_storeu_si256((__m256i *)(t + 16), _mm256_permute2x128_si256(tem[2 * h], tem[2 * h + 1], 0x31));
+            _mm256_storeu_si256((__m256i *)r, _mm256_permute2x128_si256(hum[2 * h], hum[2 * h + 1], 0x20));
+            _mm256_storeu_si256((__m256i *)(r + 16), _mm256_permute2x128_si256(hum[2 * h], hum[2 * h + 1], 0x31));
+        }
+    }
+    return ok + decode_scalar(frames + i * AHT20_FRAME_LEN, n - i, temperature + i,
+                              humidity + i, status + i);
+}
+
+#endif // AHT20_DECODE_X86
+
+#ifdef AHT20_DECODE_ARM64
+
+static inline void neon_convert(uint16x4_t w12, uint16x4_t w3, uint16x4_t w45, int16x4_t ok,
+                                int32_t *temperature, uint32_t *humidity) {
+    uint32x4_t u3 = vmovl_u16(w3);
+    uint32x4_t hum = vorrq_u32(vshll_n_u16(w12, 4), vshrq_n_u32(u3, 4));
+    uint32x4_t tem = vorrq_u32(vshlq_n_u32(vandq_u32(u3, vdupq_n_u32(0xF)), 16), vmovl_u16(w45));
+    uint32x4_t mask = vreinterpretq_u32_s32(vmovl_s16(ok));
+    int32x4_t t;
+
+    t = vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(vmulq_n_u32(tem, 125), 16)), vdupq_n_s32(500));
+    hum = vshrq_n_u32(vmulq_n_u32(hum, 125), 17);
+    vst1q_s32(temperature, vandq_s32(t, vreinterpretq_s32_u32(mask)));
+    vst1q_u32(humidity, vandq_u32(hum, mask));
+}
+
+static size_t decode_neon(const uint8_t *frames, size_t n, int32_t *temperature,
+                          uint32_t *humidity, uint8_t *status) {
+    static const uint8_t pair_idx[16] = { 0, 7, 1, 8, 2, 9, 3, 10, 4, 11, 5, 12, 6, 13, 0xFF, 0xFF };
+    const uint8x16_t pair = vld1q_u8(pair_idx);
+    const uint8x16_t nibble = vdupq_n_u8(0x0F);
+    uint8x16_t lo[6], hi[6];
+    size_t ok = 0, i;
+
+    for (int p = 0; p < 6; p++) {
+        lo[p] = vld1q_u8(crc_lo[p]);
+        hi[p] = vld1q_u8(crc_hi[p]);
+    }
+
+    for (i = 0; i + 17 <= n; i += 16) {
+        const uint8_t *f = frames + i * AHT20_FRAME_LEN;
+        uint16x8_t x[8], a[8];
+        uint32x4_t b[8];
+        uint8x16_t v[7], crc, busy, good;
+
+        for (int k = 0; k < 8; k++) {
+            x[k] = vreinterpretq_u16_u8(vqtbl1q_u8(vld1q_u8(f + 14 * k), pair));
+        }
+        for (int k = 0; k < 8; k += 2) {
+            a[k] = vzip1q_u16(x[k], x[k + 1]);
+            a[k + 1] = vzip2q_u16(x[k], x[k + 1]);
+        }
+        for (int k = 0; k < 8; k += 4) {
+            uint32x4_t a0 = vreinterpretq_u32_u16(a[k]), a1 = vreinterpretq_u32_u16(a[k + 1]);
+            uint32x4_t a2 = vreinterpretq_u32_u16(a[k + 2]), a3 = vreinterpretq_u32_u16(a[k + 3]);
+
+            b[k] = vzip1q_u32(a0, a2);
+            b[k + 1] = vzip2q_u32(a0, a2);
+            b[k + 2] = vzip1q_u32(a1, a3);
+            b[k + 3] = vzip2q_u32(a1, a3);
+        }
+        for (int k = 0; k < 4; k++) {
+            uint64x2_t lo64 = vreinterpretq_u64_u32(b[k]), hi64 = vreinterpretq_u64_u32(b[k + 4]);
+
+            v[2 * k] = vreinterpretq_u8_u64(vzip1q_u64(lo64, hi64));
+            if (k < 3) {
+                v[2 * k + 1] = vreinterpretq_u8_u64(vzip2q_u64(lo64, hi64));
+            }
+        }
+
+        crc = vdupq_n_u8(crc_init);
+        for (int p = 0; p < 6; p++) {
+            crc = veorq_u8(crc, vqtbl1q_u8(lo[p], vandq_u8(v[p], nibble)));
+            crc = veorq_u8(crc, vqtbl1q_u8(hi[p], vshrq_n_u8(v[p], 4)));
+        }
+        busy = vtstq_u8(v[0], vdupq_n_u8(AHT20_STATUS_BUSY));
+        good = vceqq_u8(crc, v[6]);
+        vst1q_u8(status + i, vorrq_u8(vandq_u8(busy, vdupq_n_u8(AHT20_FRAME_BUSY)),
+                                      vbicq_u8(vbicq_u8(vdupq_n_u8(AHT20_FRAME_CRC), good), busy)));
+        good = vbicq_u8(good, busy);
+        ok += vaddvq_u8(vandq_u8(good, vdupq_n_u8(1)));
+
+        for (int h = 0; h < 2; h++) {
+            uint8x8_t b1 = h ? vget_high_u8(v[1]) : vget_low_u8(v[1]);
+            uint8x8_t b3 = h ? vget_high_u8(v[3]) : vget_low_u8(v[3]);
+            uint8x8_t b4 = h ? vget_high_u8(v[4]) : vget_low_u8(v[4]);
+            uint8x8_t g8 = h ? vget_high_u8(good) : vget_low_u8(good);
+            uint16x8_t w12 = vaddw_u8(vshll_n_u8(b1, 8), h ? vget_high_u8(v[2]) : vget_low_u8(v[2]));
+            uint16x8_t w3 = vmovl_u8(b3);
+            uint16x8_t w45 = vaddw_u8(vshll_n_u8(b4, 8), h ? vget_high_u8(v[5]) : vget_low_u8(v[5]));
+            int16x8_t g = vmovl_s8(vreinterpret_s8_u8(g8));
+            size_t j = i + 8 * h;
+
+            neon_convert(vget_low_u16(w12), vget_low_u16(w3), vget_low_u16(w45), vget_low_s16(g),
+                         temperature + j, humidity + j);
+            neon_convert(vget_high_u16(w12), vget_high_u16(w3), vget_high_u16(w45), vget_high_s16(g),
+                         temperature + j + 4, humidity + j + 4);
+        }
+    }
+    return ok + decode_scalar(frames + i * AHT20_FRAME_LEN, n - i, temperature + i,
+                              humidity + i, status + i);
+}
+
+#endif // AHT20_DECODE_ARM64
+
+static aht20_decode_fn decode_lookup(int kernel) {
+    switch (kernel) {
+    case AHT20_DECODE_SCALAR:
+        return decode_scalar;
+#ifdef AHT20_DECODE_X86
+    case AHT20_DECODE_SSSE3:
+        return __builtin_cpu_supports("ssse3") ? decode_ssse3 : NULL;
+    case AHT20_DECODE_AVX2:
+        return __builtin_cpu_supports("avx2") ? decode_avx2 : NULL;
+#endif
+#ifdef AHT20_DECODE_ARM64
+    case AHT20_DECODE_NEON:
+        return decode_neon;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+static void decode_pick_best(void) {
+    static const int best[] = { AHT20_DECODE_AVX2, AHT20_DECODE_NEON, AHT20_DECODE_SSSE3 };
+    int kernel = AHT20_DECODE_SCALAR;
+    aht20_decode_fn fn = decode_scalar;
+
+    for (size_t k = 0; k < sizeof(best) / sizeof(best[0]); k++) {
+        if (decode_lookup(best[k])) {
+            kernel = best[k];
+            fn = decode_lookup(kernel);
+            break;
+        }
+    }
+    __atomic_store_n(&decode_fn, fn, __ATOMIC_RELAXED);
+    __atomic_store_n(&decode_kernel, kernel, __ATOMIC_RELAXED);
+}
+
+static void decode_setup(void) {
+    uint8_t zeros[6] = { 0 };
+
+    crc_init = aht20_crc8(zeros, 6);
+    for (int p = 0; p < 6; p++) {
+        for (int v = 0; v < 16; v++) {
+            uint8_t lo = v, hi = v << 4;
+
+            // Byte p is followed by 5 - p more bytes; init 0 keeps it linear
+            lo = aht20_crc_table[lo];
+            hi = aht20_crc_table[hi];
+            for (int k = p; k < 5; k++) {
+                lo = aht20_crc_table[lo];
+                hi = aht20_crc_table[hi];
+            }
+            crc_lo[p][v] = lo;
+            crc_hi[p][v] = hi;
+        }
+    }
+    decode_pick_best();
+}
+
+size_t aht20_decode_frames(const uint8_t *frames, size_t n, int32_t *temperature,
+                           uint32_t *humidity, uint8_t *status) {
+    aht20_decode_fn fn;
+
+    pthread_once(&decode_once, decode_setup);
+    fn = __atomic_load_n(&decode_fn, __ATOMIC_RELAXED);
+    return fn(frames, n, temperature, humidity, status);
+}
+
+int aht20_decode_set_kernel(int kernel) {
+    aht20_decode_fn fn;
+
+    pthread_once(&decode_once, decode_setup);
+    if (kernel == AHT20_DECODE_AUTO) {
+        decode_pick_best();
+        return 0;
+    }
+    fn = decode_lookup(kernel);
+    if (!fn) {
+        errno = ENOTSUP;
+        return -1;
+    }
+    __atomic_store_n(&decode_fn, fn, __ATOMIC_RELAXED);
+    __atomic_store_n(&decode_kernel, kernel, __ATOMIC_RELAXED);
+    return 0;
+}
+
+const char *aht20_decode_kernel_name(void) {
+    static const char *const names[] = { "auto", "scalar", "ssse3", "avx2", "neon" };
+
+    pthread_once(&decode_once, decode_setup);
+    return names[__atomic_load_n(&decode_kernel, __ATOMIC_RELAXED)];
+}
@@ -0,0 +1,72 @@
+#ifndef AHT20_INTERNAL_H
+#define AHT20_INTERNAL_H
+
+// Shared between the libaht20 sources, not installed
+
+#include "aht20.h"
+#include "aht20_proto.h"
+#include "aht20_transport.h"
+
+#define AHT20_INIT_US 10000
+#define AHT20_CONVERSION_US 80000   // datasheet: measurement takes ~80 ms
+#define AHT20_BUSY_RETRY_US 5000
+#define AHT20_BUSY_RETRIES 20       // blocking reads give up after ~100 ms extra
+#define AHT20_SOFT_RESET_US 20000   // datasheet: 0xBA completes within 20 ms
+#define AHT20_RESET_AFTER 2         // faults in one read before a soft reset
+
+#define AHT20_BUS_PATH_MAX 64
+
+// Recovery of one read: a bad CRC, a NAK or a frame busy for too long starts
+// a new conversion; the AHT20_RESET_AFTER-th fault sends 0xBA first, so the
+// next conversion also probes 0x71 and sends 0xBE. A step is only taken if
+// it can finish before the deadline. Bus recovery (clocking SCL) belongs to
+// the kernel adapter and is not reachable from here.
+struct aht20_recovery {
+    unsigned int deadline_ms;           // 0: give up on the first fault
+    struct aht20_sensor_stats *stats;   // NULL: not counted
+    int64_t deadline_ns;                // of the read in progress
+    int faults;
+    int reset;                          // 0xBA already sent in this read
+    int pending;                        // split-phase: next fetch starts a conversion
+};
+
+#define AHT20_STAT(rec, field) do { if ((rec)->stats) (rec)->stats->field++; } while (0)
+
+struct aht20_sensor {
+    char bus[AHT20_BUS_PATH_MAX];
+    struct aht20_transport *transport;
+    int owns_transport;
+    int calibrated;     // 0x71 probe is skipped once this is set
+    int mux_addr;       // -1: sensor sits directly on the bus
+    int mux_channel;
+    struct aht20_recovery recovery;
+    struct aht20_sensor_stats stats;
+};
+
+// Mux channel currently enabled on a bus, so repeated selects are skipped
+// and a second mux is switched off before another one is switched on
+struct aht20_mux_state {
+    int mux_addr;       // -1: nothing selected
+    int mux_channel;
+};
+
+int aht20_start_conversion(struct aht20_transport *t, int *calibrated);
+int aht20_read_frame(struct aht20_transport *t, int *calibrated, struct aht20_reading *r);
+// rec = NULL: blocking reads recover within AHT20_RECOVERY_DEFAULT_MS
+// without stats, split-phase fetches fail on the first fault as before
+int aht20_read_reading(struct aht20_transport *t, int *calibrated, struct aht20_recovery *rec,
+                       struct aht20_reading *r);
+int aht20_trigger_transport(struct aht20_transport *t, int *calibrated, struct aht20_recovery *rec);
+int aht20_fetch_transport(struct aht20_transport *t, int *calibrated, struct aht20_recovery *rec,
+                          int ready_fd, struct aht20_reading *r);
+int aht20_sensor_select(aht20_sensor *sensor, struct aht20_mux_state *mux);
+
+int64_t aht20_now_ns(void);
+// A read runs begin, then aht20_recover after every failed step until it
+// returns -1 or the read succeeds, then end with the final result
+void aht20_recovery_begin(struct aht20_recovery *rec);
+void aht20_recovery_end(struct aht20_recovery *rec, int ret);
+int aht20_recover(struct aht20_transport *t, int *calibrated, struct aht20_recovery *rec,
+                  long *delay_us);
+
+#endif // AHT20_INTERNAL_H
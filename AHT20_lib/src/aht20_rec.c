@@ -0,0 +1,601 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "aht20_rec.h"
+
+// File layout: header, index[nblocks], padding to block_size, blocks.
+// Block seq lives in slot seq % nblocks; seq starts at 1, 0 marks a slot
+// that was never written.
+struct aht20_rec_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t block_size;
+    uint32_t nblocks;
+    uint32_t resolution_ns;
+    uint64_t last_seq;          // block being written
+};
+
+struct aht20_rec_index {
+    uint64_t seq;
+    int64_t first_ts;           // resolution units
+};
+
+#define AHT20_REC_BLOCK_MAGIC 0x42303241    // "A20B"
+
+// First sample in full, then used bytes of varints for count - 1 samples.
+// count and used are stored last, after the bytes they cover.
+struct aht20_rec_block {
+    uint32_t magic;
+    uint32_t count;
+    uint64_t seq;
+    int64_t first_ts;
+    int32_t first_temperature;
+    uint32_t first_humidity;
+    uint32_t used;
+    uint32_t pad;
+};
+
+#define AHT20_REC_PAYLOAD (AHT20_REC_BLOCK_SIZE - sizeof(struct aht20_rec_block))
+#define AHT20_REC_MAX_ENCODED (10 + 5 + 5)  // three varints
+
+// Decoder/encoder state inside one block
+struct aht20_rec_cursor {
+    int64_t ts;
+    int64_t delta;
+    int32_t temperature;
+    int32_t humidity;
+};
+
+struct aht20_rec {
+    int fd;
+    uint8_t *map;
+    size_t size;
+    struct aht20_rec_header *hdr;
+    struct aht20_rec_index *index;
+    uint8_t *blocks;
+    struct aht20_rec_block *cur;
+    struct aht20_rec_cursor state;
+};
+
+struct aht20_rec_reader {
+    int fd;
+    const uint8_t *map;
+    size_t size;
+    const struct aht20_rec_header *hdr;
+    const struct aht20_rec_index *index;
+    const uint8_t *blocks;
+    uint64_t first_seq;
+    uint64_t seq;               // block being decoded
+    const struct aht20_rec_block *block;
+    uint32_t done;              // samples returned from it, 0 before entering it
+    uint32_t left;              // samples known to follow in [p, end)
+    const uint8_t *p;
+    const uint8_t *end;
+    struct aht20_rec_cursor state;
+};
+
+static size_t aht20_rec_data_offset(uint32_t nblocks) {
+    size_t meta = sizeof(struct aht20_rec_header) + nblocks * sizeof(struct aht20_rec_index);
+
+    return (meta + AHT20_REC_BLOCK_SIZE - 1) / AHT20_REC_BLOCK_SIZE * AHT20_REC_BLOCK_SIZE;
+}
+
+static uint64_t aht20_zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t aht20_unzigzag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static uint8_t *aht20_put_varint(uint8_t *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+// NULL if the varint runs past end
+static const uint8_t *aht20_get_varint(const uint8_t *p, const uint8_t *end, uint64_t *v) {
+    uint64_t x = 0;
+
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+
+        x |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *v = x;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static void aht20_rec_cursor_start(struct aht20_rec_cursor *c, const struct aht20_rec_block *b) {
+    c->ts = b->first_ts;
+    c->delta = 0;
+    c->temperature = b->first_temperature;
+    c->humidity = (int32_t)b->first_humidity;
+}
+
+// Decode one sample after the first; returns the next position or NULL
+static const uint8_t *aht20_rec_decode(struct aht20_rec_cursor *c, const uint8_t *p,
+                                       const uint8_t *end) {
+    uint64_t dod, dt, dh;
+
+    p = aht20_get_varint(p, end, &dod);
+    if (p) {
+        p = aht20_get_varint(p, end, &dt);
+    }
+    if (p) {
+        p = aht20_get_varint(p, end, &dh);
+    }
+    if (!p) {
+        return NULL;
+    }
+
+    c->delta += aht20_unzigzag(dod);
+    c->ts += c->delta;
+    c->temperature += (int32_t)aht20_unzigzag(dt);
+    c->humidity += (int32_t)aht20_unzigzag(dh);
+    return p;
+}
+
+static struct aht20_rec_block *aht20_rec_block(uint8_t *blocks, uint32_t nblocks, uint64_t seq) {
+    return (struct aht20_rec_block *)(blocks + (seq % nblocks) * AHT20_REC_BLOCK_SIZE);
+}
+
+// Writer
+
+static void aht20_rec_new_block(aht20_rec *rec, uint64_t seq, int64_t ts,
+                                const struct aht20_rec_sample *s) {
+    struct aht20_rec_block *b = aht20_rec_block(rec->blocks, rec->hdr->nblocks, seq);
+    struct aht20_rec_index *idx = &rec->index[seq % rec->hdr->nblocks];
+
+    // Invalidate first so a reader never pairs the old payload with the new header.
+    // The fence keeps every later store to the block, payload included, behind it.
+    __atomic_store_n(&b->magic, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&idx->seq, 0, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    b->seq = seq;
+    b->first_ts = ts;
+    b->first_temperature = s->temperature;
+    b->first_humidity = s->humidity;
+    b->used = 0;
+    b->count = 1;
+    __atomic_store_n(&b->magic, AHT20_REC_BLOCK_MAGIC, __ATOMIC_RELEASE);
+
+    idx->first_ts = ts;
+    __atomic_store_n(&idx->seq, seq, __ATOMIC_RELEASE);
+    __atomic_store_n(&rec->hdr->last_seq, seq, __ATOMIC_RELEASE);
+
+    rec->cur = b;
+    aht20_rec_cursor_start(&rec->state, b);
+}
+
+int aht20_rec_append(aht20_rec *rec, const struct aht20_rec_sample *s) {
+    int64_t ts = s->timestamp_ns / rec->hdr->resolution_ns;
+    int64_t delta;
+    uint8_t *start;
+    uint8_t *p;
+
+    if (!rec->cur) {
+        aht20_rec_new_block(rec, rec->hdr->last_seq + 1, ts, s);
+        return 0;
+    }
+    if (rec->cur->used + AHT20_REC_MAX_ENCODED > AHT20_REC_PAYLOAD) {
+        aht20_rec_new_block(rec, rec->cur->seq + 1, ts, s);
+        return 0;
+    }
+
+    delta = ts - rec->state.ts;
+    start = (uint8_t *)(rec->cur + 1) + rec->cur->used;
+    p = aht20_put_varint(start, aht20_zigzag(delta - rec->state.delta));
+    p = aht20_put_varint(p, aht20_zigzag((int64_t)s->temperature - rec->state.temperature));
+    p = aht20_put_varint(p, aht20_zigzag((int64_t)s->humidity - rec->state.humidity));
+
+    rec->state.delta = delta;
+    rec->state.ts = ts;
+    rec->state.temperature = s->temperature;
+    rec->state.humidity = (int32_t)s->humidity;
+
+    // Publish the bytes before the counters that cover them
+    __atomic_store_n(&rec->cur->used, rec->cur->used + (uint32_t)(p - start), __ATOMIC_RELEASE);
+    __atomic_store_n(&rec->cur->count, rec->cur->count + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Reopen: decode the block being written to get the encoder state back
+static int aht20_rec_resume(aht20_rec *rec) {
+    struct aht20_rec_block *b;
+    const uint8_t *p;
+    const uint8_t *end;
+
+    if (rec->hdr->last_seq == 0) {
+        return 0;                   // nothing written yet
+    }
+    b = aht20_rec_block(rec->blocks, rec->hdr->nblocks, rec->hdr->last_seq);
+    if (b->magic != AHT20_REC_BLOCK_MAGIC || b->seq != rec->hdr->last_seq ||
+        b->used > AHT20_REC_PAYLOAD) {
+        return 0;                   // torn block: start a fresh one after it
+    }
+
+    aht20_rec_cursor_start(&rec->state, b);
+    p = (const uint8_t *)(b + 1);
+    end = p + b->used;
+    for (uint32_t i = 1; i < b->count; i++) {
+        p = aht20_rec_decode(&rec->state, p, end);
+        if (!p) {
+            fprintf(stderr, "Corrupt block %llu in recording\n", (unsigned long long)b->seq);
+            return -1;
+        }
+    }
+    // Bytes past the last counted sample are from an interrupted append
+    b->used = (uint32_t)(p - (const uint8_t *)(b + 1));
+    rec->cur = b;
+    return 0;
+}
+
+aht20_rec *aht20_rec_open(const char *path, size_t size, uint32_t resolution_ns) {
+    aht20_rec *rec;
+    struct stat st;
+    uint32_t nblocks = 0;
+
+    rec = calloc(1, sizeof(*rec));
+    if (!rec) {
+        perror("Failed to allocate recorder");
+        return NULL;
+    }
+
+    rec->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (rec->fd < 0) {
+        perror("Failed to open recording");
+        free(rec);
+        return NULL;
+    }
+    if (fstat(rec->fd, &st) < 0) {
+        perror("Failed to stat recording");
+        goto fail;
+    }
+
+    if (st.st_size == 0) {
+        // Largest block count whose blocks and index fit in size
+        nblocks = (uint32_t)(size / AHT20_REC_BLOCK_SIZE);
+        while (nblocks >= 2 && aht20_rec_data_offset(nblocks) +
+               (size_t)nblocks * AHT20_REC_BLOCK_SIZE > size) {
+            nblocks--;
+        }
+        if (nblocks < 2) {
+            fprintf(stderr, "Recording size %zu is too small\n", size);
+            goto fail;
+        }
+        rec->size = aht20_rec_data_offset(nblocks) + (size_t)nblocks * AHT20_REC_BLOCK_SIZE;
+        if (ftruncate(rec->fd, rec->size) < 0) {
+            perror("Failed to size recording");
+            goto fail;
+        }
+    } else {
+        rec->size = st.st_size;
+    }
+
+    rec->map = mmap(NULL, rec->size, PROT_READ | PROT_WRITE, MAP_SHARED, rec->fd, 0);
+    if (rec->map == MAP_FAILED) {
+        perror("Failed to map recording");
+        rec->map = NULL;
+        goto fail;
+    }
+    rec->hdr = (struct aht20_rec_header *)rec->map;
+
+    if (nblocks) {
+        memcpy(rec->hdr->magic, AHT20_REC_MAGIC, sizeof(rec->hdr->magic));
+        rec->hdr->version = AHT20_REC_VERSION;
+        rec->hdr->block_size = AHT20_REC_BLOCK_SIZE;
+        rec->hdr->nblocks = nblocks;
+        rec->hdr->resolution_ns = resolution_ns ? resolution_ns : AHT20_REC_DEFAULT_RESOLUTION_NS;
+        rec->hdr->last_seq = 0;
+    } else if (rec->size < sizeof(*rec->hdr) ||
+               memcmp(rec->hdr->magic, AHT20_REC_MAGIC, sizeof(rec->hdr->magic)) != 0 ||
+               rec->hdr->version != AHT20_REC_VERSION ||
+               rec->hdr->block_size != AHT20_REC_BLOCK_SIZE || rec->hdr->nblocks < 2 ||
+               !rec->hdr->resolution_ns ||
+               aht20_rec_data_offset(rec->hdr->nblocks) +
+               (size_t)rec->hdr->nblocks * AHT20_REC_BLOCK_SIZE > rec->size) {
+        fprintf(stderr, "%s is not an AHT20 recording\n", path);
+        goto fail;
+    }
+
+    rec->index = (struct aht20_rec_index *)(rec->hdr + 1);
+    rec->blocks = rec->map + aht20_rec_data_offset(rec->hdr->nblocks);
+    if (aht20_rec_resume(rec) < 0) {
+        goto fail;
+    }
+    return rec;
+
+fail:
+    if (rec->map) {
+        munmap(rec->map, rec->size);
+    }
+    close(rec->fd);
+    free(rec);
+    return NULL;
+}
+
+int aht20_rec_sync(aht20_rec *rec) {
+    if (msync(rec->map, rec->size, MS_SYNC) < 0) {
+        perror("Failed to sync recording");
+        return -1;
+    }
+    return 0;
+}
+
+void aht20_rec_close(aht20_rec *rec) {
+    if (!rec) {
+        return;
+    }
+    munmap(rec->map, rec->size);
+    close(rec->fd);
+    free(rec);
+}
+
+// Reader
+
+aht20_rec_reader *aht20_rec_reader_open(const char *path) {
+    aht20_rec_reader *reader;
+    struct stat st;
+
+    reader = calloc(1, sizeof(*reader));
+    if (!reader) {
+        perror("Failed to allocate reader");
+        return NULL;
+    }
+
+    reader->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (reader->fd < 0) {
+        perror("Failed to open recording");
+        free(reader);
+        return NULL;
+    }
+    if (fstat(reader->fd, &st) < 0 || (size_t)st.st_size < sizeof(*reader->hdr)) {
+        fprintf(stderr, "%s is not an AHT20 recording\n", path);
+        close(reader->fd);
+        free(reader);
+        return NULL;
+    }
+    reader->size = st.st_size;
+
+    reader->map = mmap(NULL, reader->size, PROT_READ, MAP_SHARED, reader->fd, 0);
+    if (reader->map == MAP_FAILED) {
+        perror("Failed to map recording");
+        close(reader->fd);
+        free(reader);
+        return NULL;
+    }
+    // The whole file is scanned front to back
+    madvise((void *)reader->map, reader->size, MADV_SEQUENTIAL);
+
+    reader->hdr = (const struct aht20_rec_header *)reader->map;
+    if (memcmp(reader->hdr->magic, AHT20_REC_MAGIC, sizeof(reader->hdr->magic)) != 0 ||
+        reader->hdr->version != AHT20_REC_VERSION ||
+        reader->hdr->block_size != AHT20_REC_BLOCK_SIZE || reader->hdr->nblocks < 2 ||
+        !reader->hdr->resolution_ns ||
+        aht20_rec_data_offset(reader->hdr->nblocks) +
+        (size_t)reader->hdr->nblocks * AHT20_REC_BLOCK_SIZE > reader->size) {
+        fprintf(stderr, "%s is not an AHT20 recording\n", path);
+        aht20_rec_reader_close(reader);
+        return NULL;
+    }
+    reader->index = (const struct aht20_rec_index *)(reader->hdr + 1);
+    reader->blocks = reader->map + aht20_rec_data_offset(reader->hdr->nblocks);
+
+    aht20_rec_reader_rewind(reader);
+    return reader;
+}
+
+static uint64_t aht20_rec_last_seq(const aht20_rec_reader *reader) {
+    return __atomic_load_n(&reader->hdr->last_seq, __ATOMIC_ACQUIRE);
+}
+
+static uint64_t aht20_rec_first_seq(const aht20_rec_reader *reader) {
+    uint64_t last = aht20_rec_last_seq(reader);
+
+    if (last == 0) {
+        return 1;
+    }
+    // The slot after the one being written holds the oldest block
+    return last >= reader->hdr->nblocks ? last - reader->hdr->nblocks + 1 : 1;
+}
+
+void aht20_rec_reader_info(const aht20_rec_reader *reader, struct aht20_rec_info *info) {
+    info->block_size = reader->hdr->block_size;
+    info->nblocks = reader->hdr->nblocks;
+    info->resolution_ns = reader->hdr->resolution_ns;
+    info->first_block = aht20_rec_first_seq(reader);
+    info->last_block = aht20_rec_last_seq(reader);
+    info->file_size = reader->size;
+}
+
+static void aht20_rec_reader_goto(aht20_rec_reader *reader, uint64_t seq) {
+    reader->seq = seq;
+    reader->done = 0;
+    reader->left = 0;
+}
+
+void aht20_rec_reader_rewind(aht20_rec_reader *reader) {
+    reader->first_seq = aht20_rec_first_seq(reader);
+    aht20_rec_reader_goto(reader, reader->first_seq);
+}
+
+static void aht20_rec_emit(const aht20_rec_reader *reader, struct aht20_rec_sample *s) {
+    s->timestamp_ns = reader->state.ts * reader->hdr->resolution_ns;
+    s->temperature = reader->state.temperature;
+    s->humidity = (uint32_t)reader->state.humidity;
+}
+
+// Called after reading from the block: if the writer lapped the reader
+// meanwhile, what was read may mix the old block with the new one
+static int aht20_rec_reader_valid(const aht20_rec_reader *reader) {
+    const struct aht20_rec_block *b = reader->block;
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&b->magic, __ATOMIC_ACQUIRE) == AHT20_REC_BLOCK_MAGIC &&
+           __atomic_load_n(&b->seq, __ATOMIC_RELAXED) == reader->seq;
+}
+
+// Slow path: enter the next block, or pick up samples appended to the one
+// being read since its counters were last loaded. Returns 1 when left > 0
+// or a sample was emitted (*emitted set), 0 at the end, -1 on corruption.
+static int aht20_rec_reader_refill(aht20_rec_reader *reader, struct aht20_rec_sample *s,
+                                   int *emitted) {
+    for (;;) {
+        const struct aht20_rec_block *b;
+        const uint8_t *payload;
+        uint32_t count, used;
+
+        if (reader->seq > aht20_rec_last_seq(reader)) {
+            return 0;
+        }
+        b = aht20_rec_block((uint8_t *)reader->blocks, reader->hdr->nblocks, reader->seq);
+        if (__atomic_load_n(&b->magic, __ATOMIC_ACQUIRE) != AHT20_REC_BLOCK_MAGIC ||
+            b->seq != reader->seq) {
+            // Overwritten by the writer since the rewind, or never written
+            aht20_rec_reader_goto(reader, reader->seq + 1);
+            continue;
+        }
+        count = __atomic_load_n(&b->count, __ATOMIC_ACQUIRE);
+        used = __atomic_load_n(&b->used, __ATOMIC_ACQUIRE);
+        if (used > AHT20_REC_PAYLOAD || count == 0) {
+            aht20_rec_reader_goto(reader, reader->seq + 1);
+            return -1;
+        }
+
+        payload = (const uint8_t *)(b + 1);
+        reader->block = b;
+        if (reader->done == 0) {
+            // The first sample is in the header
+            aht20_rec_cursor_start(&reader->state, b);
+            if (!aht20_rec_reader_valid(reader)) {
+                aht20_rec_reader_goto(reader, reader->seq + 1);
+                continue;
+            }
+            reader->done = 1;
+            reader->p = payload;
+            reader->end = payload + used;
+            reader->left = count - 1;
+            aht20_rec_emit(reader, s);
+            *emitted = 1;
+            return 1;
+        }
+        if (count > reader->done) {
+            reader->end = payload + used;
+            reader->left = count - reader->done;
+            return 1;
+        }
+
+        // Block finished; the block being written may still grow
+        if (reader->seq == aht20_rec_last_seq(reader)) {
+            return 0;
+        }
+        aht20_rec_reader_goto(reader, reader->seq + 1);
+    }
+}
+
+int aht20_rec_reader_next(aht20_rec_reader *reader, struct aht20_rec_sample *s) {
+    const uint8_t *p;
+    int emitted;
+    int ret;
+
+    for (;;) {
+        if (!reader->left) {
+            emitted = 0;
+            ret = aht20_rec_reader_refill(reader, s, &emitted);
+            if (ret <= 0 || emitted) {
+                return ret;
+            }
+        }
+
+        p = aht20_rec_decode(&reader->state, reader->p, reader->end);
+        if (aht20_rec_reader_valid(reader)) {
+            break;
+        }
+        // Overwritten while decoding: drop the rest of the block
+        aht20_rec_reader_goto(reader, reader->seq + 1);
+    }
+    if (!p) {
+        aht20_rec_reader_goto(reader, reader->seq + 1);
+        return -1;
+    }
+    reader->p = p;
+    reader->left--;
+    reader->done++;
+    aht20_rec_emit(reader, s);
+    return 1;
+}
+
+size_t aht20_rec_reader_read(aht20_rec_reader *reader, struct aht20_rec_sample *samples, size_t n) {
+    size_t i = 0;
+
+    while (i < n) {
+        int ret = aht20_rec_reader_next(reader, &samples[i]);
+
+        if (ret == 0) {
+            break;
+        }
+        if (ret > 0) {
+            i++;
+        }
+    }
+    return i;
+}
+
+int aht20_rec_reader_seek(aht20_rec_reader *reader, int64_t timestamp_ns) {
+    int64_t ts = timestamp_ns / reader->hdr->resolution_ns;
+    uint64_t lo, hi;
+    struct aht20_rec_sample s;
+    int ret;
+
+    // Last block starting at or before ts, by binary search over the index
+    aht20_rec_reader_rewind(reader);
+    lo = reader->first_seq;
+    hi = aht20_rec_last_seq(reader);
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo + 1) / 2;
+        const struct aht20_rec_index *idx = &reader->index[mid % reader->hdr->nblocks];
+
+        if (__atomic_load_n(&idx->seq, __ATOMIC_ACQUIRE) == mid && idx->first_ts <= ts) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    aht20_rec_reader_goto(reader, lo);
+
+    // Then decode forward to the first sample at or after it
+    for (;;) {
+        struct aht20_rec_reader saved = *reader;
+
+        ret = aht20_rec_reader_next(reader, &s);
+        if (ret == 0) {
+            return 0;
+        }
+        if (ret > 0 && s.timestamp_ns / (int64_t)reader->hdr->resolution_ns >= ts) {
+            *reader = saved;
+            return 0;
+        }
+    }
+}
+
+void aht20_rec_reader_close(aht20_rec_reader *reader) {
+    if (!reader) {
+        return;
+    }
+    munmap((void *)reader->map, reader->size);
+    close(reader->fd);
+    free(reader);
+}
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include "aht20_internal.h"
+
+#define AHT20_CACHE_LINE 64
+#define AHT20_SAMPLER_PREFAULT (64 * 1024)  // stack touched before locking in
+
+// Written by the sampler thread only. lock_seq is odd while a write is in
+// progress, like struct aht20_shared in the kernel driver. On a cache line
+// of its own so readers polling it do not bounce the writer's state.
+struct aht20_sampler_slot {
+    _Alignas(AHT20_CACHE_LINE) uint32_t lock_seq;
+    struct aht20_snapshot snap;
+};
+
+struct aht20_sampler {
+    aht20_sensor *sensor;
+    struct aht20_sampler_config cfg;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t stop_cv;
+    int stop;
+    struct aht20_sampler_slot slot;
+};
+
+static void aht20_sampler_publish(struct aht20_sampler *sampler, const struct aht20_snapshot *snap) {
+    struct aht20_sampler_slot *slot = &sampler->slot;
+    uint32_t seq = slot->lock_seq;
+
+    __atomic_store_n(&slot->lock_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->snap = *snap;
+    __atomic_store_n(&slot->lock_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+// Touch the stack now so the locked pages are resident before the first
+// period; a fault inside a SCHED_FIFO loop would stall it
+static void aht20_sampler_prefault(void) {
+    volatile char stack[AHT20_SAMPLER_PREFAULT];
+
+    memset((char *)stack, 0, sizeof(stack));
+}
+
+static void *aht20_sampler_worker(void *arg) {
+    struct aht20_sampler *sampler = arg;
+    struct aht20_snapshot snap;
+    struct timespec deadline;
+    int64_t period_ns = (int64_t)sampler->cfg.period_ms * 1000000;
+    int64_t next_ns;
+
+    if (sampler->cfg.flags & AHT20_SAMPLER_MLOCK) {
+        aht20_sampler_prefault();
+    }
+
+    memset(&snap, 0, sizeof(snap));
+    next_ns = aht20_now_ns();
+
+    pthread_mutex_lock(&sampler->lock);
+    while (!sampler->stop) {
+        uint32_t temperature;
+        uint32_t humidity;
+        int ret;
+
+        pthread_mutex_unlock(&sampler->lock);
+        ret = aht20_sensor_read(sampler->sensor, &temperature, &humidity);
+        if (ret == 0) {
+            snap.seq++;
+            snap.timestamp_ns = aht20_now_ns();
+            snap.temperature = temperature;
+            snap.humidity = humidity;
+        } else {
+            snap.errors++;
+        }
+        aht20_sampler_publish(sampler, &snap);
+
+        // Fixed rate; after an overrun start counting from now
+        next_ns += period_ns;
+        if (next_ns < aht20_now_ns()) {
+            next_ns = aht20_now_ns();
+        }
+        deadline.tv_sec = next_ns / 1000000000;
+        deadline.tv_nsec = next_ns % 1000000000;
+
+        pthread_mutex_lock(&sampler->lock);
+        while (!sampler->stop &&
+               pthread_cond_timedwait(&sampler->stop_cv, &sampler->lock, &deadline) != ETIMEDOUT) {
+        }
+    }
+    pthread_mutex_unlock(&sampler->lock);
+    return NULL;
+}
+
+aht20_sampler *aht20_sampler_start(aht20_sensor *sensor, const struct aht20_sampler_config *cfg) {
+    aht20_sampler *sampler;
+    pthread_condattr_t cattr;
+    pthread_attr_t attr;
+    struct sched_param param;
+    int ret;
+
+    if (!cfg->period_ms) {
+        fprintf(stderr, "Sampler period must be at least 1 ms\n");
+        return NULL;
+    }
+
+    // Aligned so the snapshot slot really starts a cache line
+    if (posix_memalign((void **)&sampler, AHT20_CACHE_LINE, sizeof(*sampler)) != 0) {
+        fprintf(stderr, "Failed to allocate sampler\n");
+        return NULL;
+    }
+    memset(sampler, 0, sizeof(*sampler));
+    sampler->sensor = sensor;
+    sampler->cfg = *cfg;
+
+    if ((cfg->flags & AHT20_SAMPLER_MLOCK) && mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+        perror("Failed to lock memory");
+        free(sampler);
+        return NULL;
+    }
+
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sampler->stop_cv, &cattr);
+    pthread_condattr_destroy(&cattr);
+    pthread_mutex_init(&sampler->lock, NULL);
+
+    pthread_attr_init(&attr);
+    if (cfg->flags & AHT20_SAMPLER_FIFO) {
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = cfg->priority;
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        pthread_attr_setschedparam(&attr, &param);
+    }
+    ret = pthread_create(&sampler->thread, &attr, aht20_sampler_worker, sampler);
+    pthread_attr_destroy(&attr);
+    if (ret != 0) {
+        // EPERM: SCHED_FIFO needs CAP_SYS_NICE or an RLIMIT_RTPRIO
+        fprintf(stderr, "Failed to start sampler: %s\n", strerror(ret));
+        pthread_cond_destroy(&sampler->stop_cv);
+        pthread_mutex_destroy(&sampler->lock);
+        free(sampler);
+        return NULL;
+    }
+    return sampler;
+}
+
+int aht20_sampler_latest(const aht20_sampler *sampler, struct aht20_snapshot *snap) {
+    const struct aht20_sampler_slot *slot = &sampler->slot;
+    uint32_t begin, end;
+
+    do {
+        begin = __atomic_load_n(&slot->lock_seq, __ATOMIC_ACQUIRE);
+        *snap = slot->snap;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        end = __atomic_load_n(&slot->lock_seq, __ATOMIC_RELAXED);
+    } while ((begin & 1) || begin != end);
+
+    if (snap->seq == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return 0;
+}
+
+void aht20_sampler_stop(aht20_sampler *sampler) {
+    if (!sampler) {
+        return;
+    }
+
+    pthread_mutex_lock(&sampler->lock);
+    sampler->stop = 1;
+    pthread_cond_signal(&sampler->stop_cv);
+    pthread_mutex_unlock(&sampler->lock);
+    pthread_join(sampler->thread, NULL);
+
+    pthread_cond_destroy(&sampler->stop_cv);
+    pthread_mutex_destroy(&sampler->lock);
+    free(sampler);
+}
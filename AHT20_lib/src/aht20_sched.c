@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "aht20_internal.h"
+
+// Progress of one sensor through a pass
+struct aht20_inflight {
+    int64_t due_ns;             // next step may run from here on
+    int busy;                   // busy frames read for the current conversion
+};
+
+// Sensors on one bus, served by one worker thread
+struct aht20_bus {
+    struct aht20_sched *sched;
+    char path[AHT20_BUS_PATH_MAX];
+    aht20_sensor **sensors;
+    size_t *slots;              // index into the caller's results
+    struct aht20_inflight *inflight;
+    size_t count;
+    size_t cap;
+    struct aht20_mux_state mux;
+    pthread_t thread;
+};
+
+struct aht20_sched {
+    struct aht20_bus *buses;
+    size_t nbuses;
+    size_t nsensors;
+    int started;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start_cv;
+    pthread_cond_t done_cv;
+    unsigned generation;        // bumped once per pass
+    size_t pending;             // buses still working on the current pass
+    int stop;
+    struct aht20_result *results;
+};
+
+static void aht20_sleep_until(int64_t ns) {
+    struct timespec ts = { ns / 1000000000, ns % 1000000000 };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+// A failed step goes through the sensor's recovery policy: either a retry
+// is scheduled or the result fails
+static void aht20_bus_fault(struct aht20_bus *bus, size_t i, struct aht20_result *res) {
+    aht20_sensor *sensor = bus->sensors[i];
+    long delay_us;
+
+    if (aht20_recover(sensor->transport, &sensor->calibrated, &sensor->recovery, &delay_us) < 0) {
+        aht20_recovery_end(&sensor->recovery, -1);
+        res->status = -1;
+        return;
+    }
+    sensor->recovery.pending = 1;
+    bus->inflight[i].due_ns = aht20_now_ns() + (int64_t)delay_us * 1000;
+}
+
+// Next step of an in-flight sensor: start a conversion, or read its frame
+static void aht20_bus_step(struct aht20_bus *bus, size_t i, struct aht20_result *res) {
+    aht20_sensor *sensor = bus->sensors[i];
+    struct aht20_inflight *f = &bus->inflight[i];
+    struct aht20_reading r;
+    int ret;
+
+    if (aht20_sensor_select(sensor, &bus->mux) < 0) {
+        aht20_recovery_end(&sensor->recovery, -1);
+        res->status = -1;
+        return;
+    }
+
+    if (sensor->recovery.pending) {
+        sensor->recovery.pending = 0;
+        if (aht20_start_conversion(sensor->transport, &sensor->calibrated) < 0) {
+            aht20_bus_fault(bus, i, res);
+            return;
+        }
+        f->due_ns = aht20_now_ns() + (int64_t)AHT20_CONVERSION_US * 1000;
+        f->busy = 0;
+        return;
+    }
+
+    ret = aht20_read_frame(sensor->transport, &sensor->calibrated, &r);
+    if (ret == 0) {
+        aht20_recovery_end(&sensor->recovery, 0);
+        res->status = 0;
+        res->temperature = r.temperature;
+        res->humidity = r.humidity;
+        return;
+    }
+    if (ret == 1 && f->busy++ < AHT20_BUSY_RETRIES) {
+        AHT20_STAT(&sensor->recovery, busy_refetches);
+        f->due_ns = aht20_now_ns() + (int64_t)AHT20_BUSY_RETRY_US * 1000;
+        return;
+    }
+    if (ret == 1) {
+        fprintf(stderr, "Sensor is busy\n");
+        errno = ETIMEDOUT;
+    }
+    aht20_bus_fault(bus, i, res);
+}
+
+// Trigger everything back to back, then serve each sensor when its next
+// step is due: the frame one conversion window after its trigger, a busy
+// re-read, or a retry after a fault. Faults are recovered as in
+// aht20_sensor_read() and counted in the sensor's stats.
+static void aht20_bus_pass(struct aht20_bus *bus, struct aht20_result *results) {
+    for (size_t i = 0; i < bus->count; i++) {
+        struct aht20_result *res = &results[bus->slots[i]];
+        aht20_sensor *sensor = bus->sensors[i];
+
+        memset(res, 0, sizeof(*res));
+        res->sensor = sensor;
+        res->status = -1;
+        if (aht20_sensor_select(sensor, &bus->mux) < 0) {
+            continue;
+        }
+        aht20_recovery_begin(&sensor->recovery);
+        sensor->recovery.pending = 1;
+        res->status = 1;    // in flight
+        aht20_bus_step(bus, i, res);
+    }
+
+    for (;;) {
+        int64_t next = INT64_MAX;
+
+        for (size_t i = 0; i < bus->count; i++) {
+            if (results[bus->slots[i]].status == 1 && bus->inflight[i].due_ns < next) {
+                next = bus->inflight[i].due_ns;
+            }
+        }
+        if (next == INT64_MAX) {
+            return;
+        }
+        aht20_sleep_until(next);
+        next = aht20_now_ns();
+
+        // Everything due by now, in trigger order
+        for (size_t i = 0; i < bus->count; i++) {
+            struct aht20_result *res = &results[bus->slots[i]];
+
+            if (res->status == 1 && bus->inflight[i].due_ns <= next) {
+                aht20_bus_step(bus, i, res);
+            }
+        }
+    }
+}
+
+static void *aht20_bus_worker(void *arg) {
+    struct aht20_bus *bus = arg;
+    struct aht20_sched *sched = bus->sched;
+    unsigned seen = 0;
+
+    pthread_mutex_lock(&sched->lock);
+    for (;;) {
+        while (!sched->stop && sched->generation == seen) {
+            pthread_cond_wait(&sched->start_cv, &sched->lock);
+        }
+        if (sched->stop) {
+            break;
+        }
+        seen = sched->generation;
+        pthread_mutex_unlock(&sched->lock);
+
+        aht20_bus_pass(bus, sched->results);
+
+        pthread_mutex_lock(&sched->lock);
+        if (--sched->pending == 0) {
+            pthread_cond_signal(&sched->done_cv);
+        }
+    }
+    pthread_mutex_unlock(&sched->lock);
+    return NULL;
+}
+
+aht20_sched *aht20_sched_create(void) {
+    aht20_sched *sched = calloc(1, sizeof(*sched));
+
+    if (!sched) {
+        perror("Failed to allocate scheduler");
+        return NULL;
+    }
+    pthread_mutex_init(&sched->lock, NULL);
+    pthread_cond_init(&sched->start_cv, NULL);
+    pthread_cond_init(&sched->done_cv, NULL);
+    return sched;
+}
+
+static struct aht20_bus *aht20_sched_bus(aht20_sched *sched, const char *path) {
+    struct aht20_bus *buses;
+
+    for (size_t i = 0; i < sched->nbuses; i++) {
+        if (strcmp(sched->buses[i].path, path) == 0) {
+            return &sched->buses[i];
+        }
+    }
+
+    buses = realloc(sched->buses, (sched->nbuses + 1) * sizeof(*buses));
+    if (!buses) {
+        return NULL;
+    }
+    sched->buses = buses;
+    memset(&buses[sched->nbuses], 0, sizeof(*buses));
+    strcpy(buses[sched->nbuses].path, path);
+    buses[sched->nbuses].mux.mux_addr = -1;
+    return &buses[sched->nbuses++];
+}
+
+int aht20_sched_add(aht20_sched *sched, aht20_sensor *sensor) {
+    struct aht20_bus *bus;
+
+    if (sched->started) {
+        fprintf(stderr, "Scheduler already running\n");
+        return -1;
+    }
+
+    bus = aht20_sched_bus(sched, sensor->bus);
+    if (!bus) {
+        perror("Failed to add bus");
+        return -1;
+    }
+
+    if (bus->count == bus->cap) {
+        size_t cap = bus->cap ? bus->cap * 2 : 8;
+        aht20_sensor **sensors = realloc(bus->sensors, cap * sizeof(*sensors));
+        size_t *slots;
+        struct aht20_inflight *inflight;
+
+        if (!sensors) {
+            perror("Failed to add sensor");
+            return -1;
+        }
+        bus->sensors = sensors;
+        slots = realloc(bus->slots, cap * sizeof(*slots));
+        if (!slots) {
+            perror("Failed to add sensor");
+            return -1;
+        }
+        bus->slots = slots;
+        inflight = realloc(bus->inflight, cap * sizeof(*inflight));
+        if (!inflight) {
+            perror("Failed to add sensor");
+            return -1;
+        }
+        bus->inflight = inflight;
+        bus->cap = cap;
+    }
+
+    bus->sensors[bus->count] = sensor;
+    bus->slots[bus->count] = sched->nsensors++;
+    bus->count++;
+    return 0;
+}
+
+size_t aht20_sched_count(const aht20_sched *sched) {
+    return sched->nsensors;
+}
+
+static int aht20_sched_start(aht20_sched *sched) {
+    for (size_t i = 0; i < sched->nbuses; i++) {
+        sched->buses[i].sched = sched;
+        if (pthread_create(&sched->buses[i].thread, NULL, aht20_bus_worker, &sched->buses[i]) != 0) {
+            fprintf(stderr, "Failed to start bus worker\n");
+            pthread_mutex_lock(&sched->lock);
+            sched->stop = 1;
+            pthread_cond_broadcast(&sched->start_cv);
+            pthread_mutex_unlock(&sched->lock);
+            for (size_t j = 0; j < i; j++) {
+                pthread_join(sched->buses[j].thread, NULL);
+            }
+            sched->stop = 0;
+            return -1;
+        }
+    }
+    sched->started = 1;
+    return 0;
+}
+
+int aht20_sched_read_all(aht20_sched *sched, struct aht20_result *results, size_t n) {
+    int ok = 0;
+
+    if (n < sched->nsensors) {
+        fprintf(stderr, "Result array too small\n");
+        return -1;
+    }
+    if (!sched->started && aht20_sched_start(sched) < 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&sched->lock);
+    sched->results = results;
+    sched->pending = sched->nbuses;
+    sched->generation++;
+    pthread_cond_broadcast(&sched->start_cv);
+    while (sched->pending > 0) {
+        pthread_cond_wait(&sched->done_cv, &sched->lock);
+    }
+    sched->results = NULL;
+    pthread_mutex_unlock(&sched->lock);
+
+    for (size_t i = 0; i < sched->nsensors; i++) {
+        if (results[i].status == 0) {
+            ok++;
+        }
+    }
+    return ok;
+}
+
+void aht20_sched_destroy(aht20_sched *sched) {
+    if (!sched) {
+        return;
+    }
+
+    if (sched->started) {
+        pthread_mutex_lock(&sched->lock);
+        sched->stop = 1;
+        pthread_cond_broadcast(&sched->start_cv);
+        pthread_mutex_unlock(&sched->lock);
+        for (size_t i = 0; i < sched->nbuses; i++) {
+            pthread_join(sched->buses[i].thread, NULL);
+        }
+    }
+
+    for (size_t i = 0; i < sched->nbuses; i++) {
+        free(sched->buses[i].sensors);
+        free(sched->buses[i].slots);
+        free(sched->buses[i].inflight);
+    }
+    free(sched->buses);
+    pthread_cond_destroy(&sched->done_cv);
+    pthread_cond_destroy(&sched->start_cv);
+    pthread_mutex_destroy(&sched->lock);
+    free(sched);
+}
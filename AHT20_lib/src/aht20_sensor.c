@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "aht20_internal.h"
+
+aht20_sensor *aht20_sensor_open_transport(struct aht20_transport *transport, const char *bus,
+                                          int mux_addr, int mux_channel) {
+    aht20_sensor *sensor;
+
+    if (!bus) {
+        bus = I2C_DEVICE;
+    }
+    if (strlen(bus) >= AHT20_BUS_PATH_MAX) {
+        fprintf(stderr, "I2C bus path too long: %s\n", bus);
+        return NULL;
+    }
+    if (mux_addr >= 0 && (mux_channel < 0 || mux_channel > 7)) {
+        fprintf(stderr, "Invalid mux channel %d\n", mux_channel);
+        return NULL;
+    }
+
+    sensor = calloc(1, sizeof(*sensor));
+    if (!sensor) {
+        perror("Failed to allocate sensor");
+        return NULL;
+    }
+
+    strcpy(sensor->bus, bus);
+    sensor->transport = transport;
+    sensor->mux_addr = mux_addr;
+    sensor->mux_channel = mux_channel;
+    sensor->recovery.deadline_ms = AHT20_RECOVERY_DEFAULT_MS;
+    sensor->recovery.stats = &sensor->stats;
+    return sensor;
+}
+
+aht20_sensor *aht20_sensor_open(const char *bus, int mux_addr, int mux_channel) {
+    struct aht20_transport *transport;
+    aht20_sensor *sensor;
+
+    transport = aht20_transport_i2c_open(bus ? bus : I2C_DEVICE);
+    if (!transport) {
+        return NULL;
+    }
+
+    sensor = aht20_sensor_open_transport(transport, bus, mux_addr, mux_channel);
+    if (!sensor) {
+        aht20_transport_close(transport);
+        return NULL;
+    }
+    sensor->owns_transport = 1;
+    return sensor;
+}
+
+static int aht20_mux_write(struct aht20_transport *t, int mux_addr, uint8_t mask) {
+    struct aht20_msg msg = { (uint16_t)mux_addr, 0, 1, &mask };
+
+    // The mux switches on STOP, so this is a transaction of its own
+    if (aht20_transport_xfer(t, &msg, 1) < 0) {
+        perror("Failed to select mux channel");
+        return -1;
+    }
+    return 0;
+}
+
+// Route the bus to this sensor. With a mux state the write is skipped when
+// the right channel is already on, and any other mux on the same bus is
+// switched off first so two sensors never answer at once.
+int aht20_sensor_select(aht20_sensor *sensor, struct aht20_mux_state *mux) {
+    int selected;
+
+    if (sensor->mux_addr < 0) {
+        return 0;
+    }
+
+    selected = mux && mux->mux_addr == sensor->mux_addr &&
+               mux->mux_channel == sensor->mux_channel;
+    if (selected) {
+        return 0;
+    }
+
+    if (mux && mux->mux_addr >= 0 && mux->mux_addr != sensor->mux_addr) {
+        if (aht20_mux_write(sensor->transport, mux->mux_addr, 0) < 0) {
+            return -1;
+        }
+        mux->mux_addr = -1;
+    }
+    if (aht20_mux_write(sensor->transport, sensor->mux_addr, 1 << sensor->mux_channel) < 0) {
+        if (mux) {
+            mux->mux_addr = -1;
+        }
+        return -1;
+    }
+    if (mux) {
+        mux->mux_addr = sensor->mux_addr;
+        mux->mux_channel = sensor->mux_channel;
+    }
+    return 0;
+}
+
+int aht20_sensor_read(aht20_sensor *sensor, uint32_t *temperature, uint32_t *humidity) {
+    struct aht20_reading r;
+
+    if (aht20_sensor_select(sensor, NULL) < 0) {
+        return -1;
+    }
+    if (aht20_read_reading(sensor->transport, &sensor->calibrated, &sensor->recovery, &r) < 0) {
+        return -1;
+    }
+
+    if (temperature) {
+        *temperature = r.temperature;
+    }
+    if (humidity) {
+        *humidity = r.humidity;
+    }
+    return 0;
+}
+
+int aht20_sensor_trigger(aht20_sensor *sensor) {
+    if (aht20_sensor_select(sensor, NULL) < 0) {
+        return -1;
+    }
+    return aht20_trigger_transport(sensor->transport, &sensor->calibrated, &sensor->recovery);
+}
+
+int aht20_sensor_fetch(aht20_sensor *sensor, int ready_fd, uint32_t *temperature,
+                       uint32_t *humidity) {
+    struct aht20_reading r;
+    int ret;
+
+    // Another sensor behind the same mux may have been selected meanwhile.
+    // No recovery here: with the mux state unknown, a 0xBA could reach
+    // another sensor. The scheduler fails the read the same way.
+    if (aht20_sensor_select(sensor, NULL) < 0) {
+        aht20_recovery_end(&sensor->recovery, -1);
+        close(ready_fd);
+        return -1;
+    }
+    ret = aht20_fetch_transport(sensor->transport, &sensor->calibrated, &sensor->recovery,
+                                ready_fd, &r);
+    if (ret != 0) {
+        return ret;
+    }
+
+    if (temperature) {
+        *temperature = r.temperature;
+    }
+    if (humidity) {
+        *humidity = r.humidity;
+    }
+    return 0;
+}
+
+void aht20_sensor_set_recovery(aht20_sensor *sensor, unsigned int deadline_ms) {
+    sensor->recovery.deadline_ms = deadline_ms;
+}
+
+void aht20_sensor_get_stats(const aht20_sensor *sensor, struct aht20_sensor_stats *stats) {
+    *stats = sensor->stats;
+}
+
+const char *aht20_sensor_bus(const aht20_sensor *sensor) {
+    return sensor->bus;
+}
+
+struct aht20_transport *aht20_sensor_transport(aht20_sensor *sensor) {
+    return sensor->transport;
+}
+
+void aht20_sensor_close(aht20_sensor *sensor) {
+    if (!sensor) {
+        return;
+    }
+    if (sensor->owns_transport) {
+        aht20_transport_close(sensor->transport);
+    }
+    free(sensor);
+}
@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "aht20_internal.h"
+#include "aht20_sim.h"
+
+#define AHT20_TRANSPORT_OWNS_FD 0x01
+#define AHT20_TRANSPORT_NO_RDWR 0x02
+
+#define AHT20_XFER_MAX 4
+
+int aht20_transport_xfer(struct aht20_transport *t, struct aht20_msg *msgs, int n) {
+    int ret;
+
+    t->stats.xfers++;
+    t->stats.msgs += n;
+    ret = t->ops->xfer(t, msgs, n);
+    if (ret < 0) {
+        t->stats.errors++;
+    }
+    return ret;
+}
+
+void aht20_transport_close(struct aht20_transport *t) {
+    if (!t) {
+        return;
+    }
+    if (t->ops->close) {
+        t->ops->close(t);
+    }
+}
+
+// Fallback for SMBus-only adapters: one syscall pair per message
+static int aht20_i2c_xfer_rw(struct aht20_transport *t, struct aht20_msg *msgs, int n) {
+    for (int i = 0; i < n; i++) {
+        ssize_t ret;
+
+        if (ioctl(t->fd, I2C_SLAVE, msgs[i].addr) < 0) {
+            return -1;
+        }
+        if (msgs[i].flags & AHT20_MSG_READ) {
+            ret = read(t->fd, msgs[i].buf, msgs[i].len);
+        } else {
+            ret = write(t->fd, msgs[i].buf, msgs[i].len);
+        }
+        if (ret != msgs[i].len) {
+            if (ret >= 0) {
+                errno = EIO;
+            }
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int aht20_i2c_xfer(struct aht20_transport *t, struct aht20_msg *msgs, int n) {
+    struct i2c_msg m[AHT20_XFER_MAX];
+    struct i2c_rdwr_ioctl_data rdwr;
+
+    if (n > AHT20_XFER_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (t->flags & AHT20_TRANSPORT_NO_RDWR) {
+        return aht20_i2c_xfer_rw(t, msgs, n);
+    }
+
+    for (int i = 0; i < n; i++) {
+        m[i].addr = msgs[i].addr;
+        m[i].flags = (msgs[i].flags & AHT20_MSG_READ) ? I2C_M_RD : 0;
+        m[i].len = msgs[i].len;
+        m[i].buf = msgs[i].buf;
+    }
+    rdwr.msgs = m;
+    rdwr.nmsgs = n;
+
+    if (ioctl(t->fd, I2C_RDWR, &rdwr) < 0) {
+        if (errno == EOPNOTSUPP || errno == ENOTTY) {
+            t->flags |= AHT20_TRANSPORT_NO_RDWR;
+            return aht20_i2c_xfer_rw(t, msgs, n);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+static void aht20_i2c_close(struct aht20_transport *t) {
+    if (t->flags & AHT20_TRANSPORT_OWNS_FD) {
+        close(t->fd);
+        free(t);
+    }
+}
+
+static const struct aht20_transport_ops aht20_i2c_ops = {
+    .xfer = aht20_i2c_xfer,
+    .close = aht20_i2c_close,
+};
+
+void aht20_transport_i2c_wrap(struct aht20_transport *t, int file) {
+    memset(t, 0, sizeof(*t));
+    t->ops = &aht20_i2c_ops;
+    t->fd = file;
+}
+
+struct aht20_transport *aht20_transport_i2c_open(const char *bus) {
+    struct aht20_transport *t = malloc(sizeof(*t));
+    int file;
+
+    if (!t) {
+        perror("Failed to allocate transport");
+        return NULL;
+    }
+
+    file = open(bus, O_RDWR | O_CLOEXEC);
+    if (file < 0) {
+        perror("Failed to open I2C device");
+        free(t);
+        return NULL;
+    }
+
+    aht20_transport_i2c_wrap(t, file);
+    t->flags |= AHT20_TRANSPORT_OWNS_FD;
+    return t;
+}
+
+// In-memory sensor
+struct aht20_mem {
+    uint8_t status;             // calibrated bits once 0xBE was sent
+    uint32_t raw_humidity;
+    uint32_t raw_temperature;
+};
+
+static int aht20_mem_xfer(struct aht20_transport *t, struct aht20_msg *msgs, int n) {
+    struct aht20_mem *mem = t->ctx;
+
+    for (int i = 0; i < n; i++) {
+        struct aht20_msg *m = &msgs[i];
+
+        if (m->addr != AHT20_ADDR) {
+            if (m->flags & AHT20_MSG_READ) {
+                errno = ENXIO;
+                return -1;
+            }
+            continue;           // mux channel select
+        }
+
+        if (m->flags & AHT20_MSG_READ) {
+            uint8_t frame[AHT20_FRAME_LEN];
+
+            aht20_encode_frame(frame, mem->status, mem->raw_humidity, mem->raw_temperature);
+            memcpy(m->buf, frame, m->len < AHT20_FRAME_LEN ? m->len : AHT20_FRAME_LEN);
+        } else if (m->len > 0 && m->buf[0] == AHT20_CMD_INIT) {
+            mem->status |= AHT20_STATUS_CALIBRATED;
+        }
+    }
+    return 0;
+}
+
+static void aht20_mem_close(struct aht20_transport *t) {
+    free(t->ctx);
+    free(t);
+}
+
+static const struct aht20_transport_ops aht20_mem_ops = {
+    .xfer = aht20_mem_xfer,
+    .close = aht20_mem_close,
+};
+
+struct aht20_transport *aht20_transport_mem_open(void) {
+    struct aht20_transport *t = calloc(1, sizeof(*t));
+    struct aht20_mem *mem = calloc(1, sizeof(*mem));
+
+    if (!t || !mem) {
+        perror("Failed to allocate transport");
+        free(t);
+        free(mem);
+        return NULL;
+    }
+
+    // 25.0 C, 50.0 %RH until told otherwise
+    mem->raw_humidity = 1 << 19;
+    mem->raw_temperature = 393216;
+    t->ops = &aht20_mem_ops;
+    t->ctx = mem;
+    t->fd = -1;
+    return t;
+}
+
+void aht20_transport_mem_set(struct aht20_transport *t, uint32_t raw_humidity,
+                             uint32_t raw_temperature) {
+    struct aht20_mem *mem = t->ctx;
+
+    mem->raw_humidity = raw_humidity & 0xFFFFF;
+    mem->raw_temperature = raw_temperature & 0xFFFFF;
+}
+
+// Simulated sensors: real conversion time, busy bit and injected faults.
+// One sensor sits directly on the bus and one behind each channel of the
+// muxes at 0x70-0x77, so a scheduler bench sees independent conversions.
+#define AHT20_SIM_MUX_BASE 0x70
+#define AHT20_SIM_MUXES 8
+#define AHT20_SIM_SENSORS (1 + AHT20_SIM_MUXES * 8)
+
+struct aht20_sim_bus {
+    uint8_t mux[AHT20_SIM_MUXES];       // channel mask per mux
+    struct aht20_sim sensors[AHT20_SIM_SENSORS];
+};
+
+static uint64_t aht20_sim_now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Sensor answering at 0x38: the lowest enabled mux channel, else the direct one
+static struct aht20_sim *aht20_sim_selected(struct aht20_sim_bus *bus) {
+    for (int m = 0; m < AHT20_SIM_MUXES; m++) {
+        for (int ch = 0; ch < 8; ch++) {
+            if (bus->mux[m] & (1 << ch)) {
+                return &bus->sensors[1 + m * 8 + ch];
+            }
+        }
+    }
+    return &bus->sensors[0];
+}
+
+static int aht20_sim_xfer(struct aht20_transport *t, struct aht20_msg *msgs, int n) {
+    struct aht20_sim_bus *bus = t->ctx;
+    uint64_t now = aht20_sim_now_us();
+
+    for (int i = 0; i < n; i++) {
+        struct aht20_msg *m = &msgs[i];
+        struct aht20_sim *sim;
+
+        if (m->addr >= AHT20_SIM_MUX_BASE && m->addr < AHT20_SIM_MUX_BASE + AHT20_SIM_MUXES &&
+            !(m->flags & AHT20_MSG_READ)) {
+            if (m->len > 0) {
+                bus->mux[m->addr - AHT20_SIM_MUX_BASE] = m->buf[0];
+            }
+            continue;
+        }
+        if (m->addr != AHT20_ADDR) {
+            errno = ENXIO;
+            return -1;
+        }
+
+        // A NAK aborts the rest of the transaction
+        sim = aht20_sim_selected(bus);
+        if (aht20_sim_nak(sim)) {
+            errno = EREMOTEIO;
+            return -1;
+        }
+        if (m->flags & AHT20_MSG_READ) {
+            aht20_sim_read(sim, m->buf, m->len, now);
+        } else {
+            aht20_sim_write(sim, m->buf, m->len, now);
+        }
+    }
+    return 0;
+}
+
+// Same teardown as the memory backend: free ctx and the transport
+static const struct aht20_transport_ops aht20_sim_ops = {
+    .xfer = aht20_sim_xfer,
+    .close = aht20_mem_close,
+};
+
+struct aht20_transport *aht20_transport_sim_open(const struct aht20_sim_config *cfg) {
+    struct aht20_transport *t = calloc(1, sizeof(*t));
+    struct aht20_sim_bus *bus = calloc(1, sizeof(*bus));
+    struct aht20_sim_config defaults;
+    uint64_t now = aht20_sim_now_us();
+
+    if (!t || !bus) {
+        perror("Failed to allocate transport");
+        free(t);
+        free(bus);
+        return NULL;
+    }
+
+    if (!cfg) {
+        aht20_sim_defaults(&defaults);
+        cfg = &defaults;
+    }
+    for (int i = 0; i < AHT20_SIM_SENSORS; i++) {
+        struct aht20_sim_config c = *cfg;
+
+        // Same waveforms, independent fault sequences
+        c.seed = (cfg->seed ? cfg->seed : 1) + i * 0x9E3779B9u;
+        aht20_sim_init(&bus->sensors[i], &c, now);
+    }
+    t->ops = &aht20_sim_ops;
+    t->ctx = bus;
+    t->fd = -1;
+    return t;
+}
+
+int aht20_transport_sim_stats(const struct aht20_transport *t, struct aht20_sim_stats *stats) {
+    const struct aht20_sim_bus *bus = t->ctx;
+
+    if (t->ops != &aht20_sim_ops) {
+        fprintf(stderr, "Not a simulated transport\n");
+        return -1;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < AHT20_SIM_SENSORS; i++) {
+        const struct aht20_sim_stats *st = &bus->sensors[i].stats;
+
+        stats->triggers += st->triggers;
+        stats->frames += st->frames;
+        stats->busy_frames += st->busy_frames;
+        stats->crc_errors += st->crc_errors;
+        stats->naks += st->naks;
+        stats->inits += st->inits;
+        stats->resets += st->resets;
+    }
+    return 0;
+}
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "aht20d.h"
+
+int aht20d_connect(const char *path) {
+    struct sockaddr_un addr;
+    int fd;
+
+    if (!path) {
+        path = AHT20D_SOCKET;
+    }
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Failed to create socket");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("Failed to connect to aht20d");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int aht20d_send(int fd, uint32_t type, uint32_t sensor, uint64_t mask) {
+    struct aht20d_request req = { type, sensor, mask };
+
+    if (send(fd, &req, sizeof(req), MSG_NOSIGNAL) != sizeof(req)) {
+        perror("Failed to send request");
+        return -1;
+    }
+    return 0;
+}
+
+// One message; AHT20D_MSG_ERROR comes back as -1 with its errno
+static int aht20d_recv(int fd, struct aht20d_message *msg) {
+    ssize_t n;
+
+    n = recv(fd, msg, sizeof(*msg), 0);
+    if (n < 0) {
+        if (errno != EAGAIN) {
+            perror("Failed to receive from aht20d");
+        }
+        return -1;
+    }
+    if (n == 0) {
+        errno = ECONNRESET;
+        return -1;
+    }
+    if ((size_t)n < sizeof(*msg)) {
+        fprintf(stderr, "Short message from aht20d\n");
+        errno = EPROTO;
+        return -1;
+    }
+    if (msg->type == AHT20D_MSG_ERROR) {
+        errno = msg->error;
+        return -1;
+    }
+    return 0;
+}
+
+int aht20d_info(int fd, struct aht20d_info *info) {
+    struct aht20d_message msg;
+
+    if (aht20d_send(fd, AHT20D_REQ_INFO, 0, 0) < 0) {
+        return -1;
+    }
+    do {
+        if (aht20d_recv(fd, &msg) < 0) {
+            return -1;
+        }
+    } while (msg.type != AHT20D_MSG_INFO);
+    *info = msg.info;
+    return 0;
+}
+
+// On a subscribed connection the reply may come after stream samples of
+// the same sensor; any of them is at least as new as what was asked for
+int aht20d_query(int fd, uint32_t sensor, struct aht20d_sample *sample) {
+    struct aht20d_message msg;
+
+    if (aht20d_send(fd, AHT20D_REQ_QUERY, sensor, 0) < 0) {
+        return -1;
+    }
+    do {
+        if (aht20d_recv(fd, &msg) < 0) {
+            return -1;
+        }
+    } while (msg.type != AHT20D_MSG_SAMPLE || msg.sample.sensor != sensor);
+    *sample = msg.sample;
+    return 0;
+}
+
+int aht20d_subscribe(int fd, uint64_t mask) {
+    return aht20d_send(fd, AHT20D_REQ_SUBSCRIBE, 0, mask);
+}
+
+int aht20d_unsubscribe(int fd, uint64_t mask) {
+    return aht20d_send(fd, AHT20D_REQ_UNSUBSCRIBE, 0, mask);
+}
+
+int aht20d_next(int fd, struct aht20d_sample *sample) {
+    struct aht20d_message msg;
+
+    do {
+        if (aht20d_recv(fd, &msg) < 0) {
+            return -1;
+        }
+    } while (msg.type != AHT20D_MSG_SAMPLE);
+    *sample = msg.sample;
+    return 0;
+}
+
+const struct aht20d_shm *aht20d_shm_open(const char *name) {
+    const struct aht20d_shm *shm;
+    int fd;
+
+    fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Failed to open aht20d shared memory");
+        return NULL;
+    }
+    shm = mmap(NULL, sizeof(*shm), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) {
+        perror("Failed to map aht20d shared memory");
+        return NULL;
+    }
+    if (shm->magic != AHT20D_SHM_MAGIC) {
+        fprintf(stderr, "%s is not an aht20d shared memory object\n", name);
+        munmap((void *)shm, sizeof(*shm));
+        errno = EINVAL;
+        return NULL;
+    }
+    return shm;
+}
+
+void aht20d_shm_close(const struct aht20d_shm *shm) {
+    if (shm) {
+        munmap((void *)shm, sizeof(*shm));
+    }
+}
@@ -0,0 +1,82 @@
+// Export an aht20_rec recording as CSV on stdout:
+//   timestamp_ns,temperature_c,humidity_rh
+//
+//   ./tools/aht20_export [--from NS] [--to NS] [--info] FILE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <getopt.h>
+#include "aht20_rec.h"
+
+int main(int argc, char *argv[]) {
+    static const struct option opts[] = {
+        { "from", required_argument, NULL, 'f' },
+        { "to", required_argument, NULL, 't' },
+        { "info", no_argument, NULL, 'i' },
+        { NULL, 0, NULL, 0 },
+    };
+    aht20_rec_reader *reader;
+    struct aht20_rec_sample s;
+    int64_t from = INT64_MIN, to = INT64_MAX;
+    int info = 0;
+    size_t samples = 0, corrupt = 0;
+    int ret;
+    int c;
+
+    while ((c = getopt_long(argc, argv, "f:t:i", opts, NULL)) != -1) {
+        switch (c) {
+        case 'f': from = strtoll(optarg, NULL, 0); break;
+        case 't': to = strtoll(optarg, NULL, 0); break;
+        case 'i': info = 1; break;
+        default:
+            fprintf(stderr, "usage: %s [--from NS] [--to NS] [--info] FILE\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [--from NS] [--to NS] [--info] FILE\n", argv[0]);
+        return 1;
+    }
+
+    reader = aht20_rec_reader_open(argv[optind]);
+    if (!reader) {
+        return 1;
+    }
+    if (from != INT64_MIN) {
+        aht20_rec_reader_seek(reader, from);
+    }
+
+    printf("timestamp_ns,temperature_c,humidity_rh\n");
+    while ((ret = aht20_rec_reader_next(reader, &s)) != 0) {
+        if (ret < 0) {
+            corrupt++;
+            continue;
+        }
+        if (s.timestamp_ns > to) {
+            break;
+        }
+        // Same fixed-point formatting as test_lib.c
+        printf("%lld,%s%d.%d,%u.%u\n", (long long)s.timestamp_ns,
+               s.temperature < 0 ? "-" : "", abs(s.temperature) / 10, abs(s.temperature) % 10,
+               s.humidity / 10, s.humidity % 10);
+        samples++;
+    }
+
+    if (info) {
+        struct aht20_rec_info ri;
+
+        aht20_rec_reader_info(reader, &ri);
+        fprintf(stderr, "file_size=%zu blocks=%u block_size=%u resolution_ns=%u "
+                "first_block=%llu last_block=%llu samples=%zu bytes_per_sample=%.2f\n",
+                ri.file_size, ri.nblocks, ri.block_size, ri.resolution_ns,
+                (unsigned long long)ri.first_block, (unsigned long long)ri.last_block, samples,
+                samples ? (double)(ri.last_block - ri.first_block + 1) * ri.block_size / samples : 0.0);
+    }
+    if (corrupt) {
+        fprintf(stderr, "%zu corrupt blocks skipped\n", corrupt);
+    }
+
+    aht20_rec_reader_close(reader);
+    return corrupt ? 2 : 0;
+}
@@ -0,0 +1,121 @@
+// Client of aht20d: print the latest sample of a sensor, or stream them.
+//
+//   ./tools/aht20_query [--socket PATH] [--watch] [--shm] [SENSOR]
+//
+// --watch subscribes to SENSOR (all sensors without one) and prints every
+// new sample. --shm reads the daemon's shared memory instead of the socket.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <unistd.h>
+#include "aht20d.h"
+
+static void print_sample(const struct aht20d_sample *s) {
+    if (s->error) {
+        printf("sensor %u: seq %llu error: %s\n", s->sensor, (unsigned long long)s->seq,
+               strerror(s->error));
+    } else {
+        printf("sensor %u: seq %llu t=%lld.%09lld Temperature: %.1f C, Humidity: %.1f %%\n",
+               s->sensor, (unsigned long long)s->seq,
+               (long long)(s->timestamp_ns / 1000000000), (long long)(s->timestamp_ns % 1000000000),
+               s->temperature / 10.0, s->humidity / 10.0);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option opts[] = {
+        { "socket", required_argument, NULL, 's' },
+        { "watch", no_argument, NULL, 'w' },
+        { "shm", no_argument, NULL, 'm' },
+        { NULL, 0, NULL, 0 },
+    };
+    const char *socket_path = NULL;
+    struct aht20d_info info;
+    struct aht20d_sample sample;
+    int watch = 0, use_shm = 0, all = 1;
+    uint32_t sensor = 0;
+    int fd, c;
+
+    while ((c = getopt_long(argc, argv, "s:wm", opts, NULL)) != -1) {
+        switch (c) {
+        case 's': socket_path = optarg; break;
+        case 'w': watch = 1; break;
+        case 'm': use_shm = 1; break;
+        default:
+            fprintf(stderr, "usage: %s [--socket PATH] [--watch] [--shm] [SENSOR]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc) {
+        sensor = strtoul(argv[optind], NULL, 0);
+        all = 0;
+    }
+
+    fd = aht20d_connect(socket_path);
+    if (fd < 0 || aht20d_info(fd, &info) < 0) {
+        return 1;
+    }
+    if (!all && sensor >= info.nsensors) {
+        fprintf(stderr, "aht20d has %u sensors\n", info.nsensors);
+        return 1;
+    }
+
+    if (use_shm) {
+        const struct aht20d_shm *shm;
+        uint64_t seen[AHT20D_MAX_SENSORS] = { 0 };
+
+        if (!info.shm_name[0]) {
+            fprintf(stderr, "aht20d runs without --shm\n");
+            return 1;
+        }
+        shm = aht20d_shm_open(info.shm_name);
+        if (!shm) {
+            return 1;
+        }
+        close(fd);
+        // Poll twice per period; only new samples are printed
+        do {
+            for (uint32_t i = all ? 0 : sensor; i < (all ? info.nsensors : sensor + 1); i++) {
+                aht20d_shm_read(shm, i, &sample);
+                if (sample.seq != seen[i]) {
+                    seen[i] = sample.seq;
+                    print_sample(&sample);
+                }
+            }
+            if (watch) {
+                usleep(info.period_ms * 500);
+            }
+        } while (watch);
+        aht20d_shm_close(shm);
+        return 0;
+    }
+
+    if (!watch) {
+        for (uint32_t i = all ? 0 : sensor; i < (all ? info.nsensors : sensor + 1); i++) {
+            if (aht20d_query(fd, i, &sample) < 0) {
+                perror("Query failed");
+                return 1;
+            }
+            print_sample(&sample);
+        }
+        close(fd);
+        return 0;
+    }
+
+    if (aht20d_subscribe(fd, all ? (info.nsensors == 64 ? ~0ULL : (1ULL << info.nsensors) - 1)
+                                 : 1ULL << sensor) < 0) {
+        return 1;
+    }
+    while (aht20d_next(fd, &sample) == 0) {
+        print_sample(&sample);
+    }
+    if (errno != ECONNRESET) {
+        perror("aht20d");
+    }
+    close(fd);
+    return 0;
+}
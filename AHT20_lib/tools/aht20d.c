@@ -0,0 +1,529 @@
+// aht20d: owns the sensors, samples each one once per period and serves
+// the latest values to any number of local clients (protocol in aht20d.h).
+// Bus traffic is one conversion per sensor per period, whatever the number
+// of clients.
+//
+//   ./tools/aht20d [--period MS] [--socket PATH] [--shm NAME] [--sim]
+//                  [--sensor BUS[:MUX:CH]]...
+//
+// --sensor defaults to one sensor on I2C_DEVICE. MUX is 0x70..0x77, CH 0..7.
+// --sim puts every sensor on the simulated transport instead. Runs in the
+// foreground; SIGINT/SIGTERM remove the socket and shared memory object.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include "aht20.h"
+#include "aht20_sim.h"
+#include "aht20d.h"
+
+#define AHT20D_MAX_CLIENTS 256
+
+// epoll tags: kind in the top 32 bits, index below
+#define TAG_LISTEN 1
+#define TAG_TIMER 2
+#define TAG_SIGNAL 3
+#define TAG_SENSOR 4
+#define TAG_CLIENT 5
+#define TAG(kind, i) (((uint64_t)(kind) << 32) | (uint32_t)(i))
+
+struct sensor_state {
+    aht20_sensor *sensor;
+    char spec[96];
+    int ready_fd;               // -1 when no conversion is in flight
+    struct aht20d_sample last;
+    unsigned long overruns;     // periods skipped, conversion still in flight
+};
+
+struct client {
+    int fd;                     // -1: free slot
+    uint64_t subscribed;
+    uint64_t waiting;           // QUERY before the first sample
+    unsigned long drops;
+};
+
+static struct sensor_state sensors[AHT20D_MAX_SENSORS];
+static unsigned nsensors;
+static struct client clients[AHT20D_MAX_CLIENTS];
+static struct aht20d_shm *shm;
+static uint32_t period_ms = 1000;
+static const char *shm_name;
+static int epfd;
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int watch(int fd, int op, uint32_t events, uint64_t tag) {
+    struct epoll_event ev = { .events = events, .data.u64 = tag };
+
+    if (epoll_ctl(epfd, op, fd, &ev) < 0) {
+        perror("epoll_ctl");
+        return -1;
+    }
+    return 0;
+}
+
+static void client_drop(unsigned i) {
+    close(clients[i].fd);
+    clients[i].fd = -1;
+}
+
+// Non-blocking: a client whose socket buffer is full loses this message
+static int client_send(unsigned i, const struct aht20d_message *msg) {
+    if (send(clients[i].fd, msg, sizeof(*msg), MSG_DONTWAIT | MSG_NOSIGNAL) == sizeof(*msg)) {
+        return 0;
+    }
+    if (errno == EAGAIN) {
+        clients[i].drops++;
+        return 0;
+    }
+    client_drop(i);
+    return -1;
+}
+
+static void send_sample(unsigned i, const struct aht20d_sample *s) {
+    struct aht20d_message msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.type = AHT20D_MSG_SAMPLE;
+    msg.sample = *s;
+    client_send(i, &msg);
+}
+
+static void send_error(unsigned i, int err) {
+    struct aht20d_message msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.type = AHT20D_MSG_ERROR;
+    msg.error = err;
+    client_send(i, &msg);
+}
+
+static void shm_publish(unsigned idx, const struct aht20d_sample *s) {
+    struct aht20d_shm_slot *slot = &shm->slots[idx];
+    uint32_t seq = slot->lock_seq;
+
+    __atomic_store_n(&slot->lock_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->sample = *s;
+    __atomic_store_n(&slot->lock_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+// One reading done: shared memory, subscribers, then pending queries
+static void publish(unsigned idx, int error, uint32_t temperature, uint32_t humidity) {
+    struct aht20d_sample *s = &sensors[idx].last;
+    uint64_t bit = 1ULL << idx;
+
+    s->sensor = idx;
+    s->error = error;
+    s->seq++;
+    if (!error) {
+        s->timestamp_ns = now_ns();
+        s->temperature = (int32_t)temperature;
+        s->humidity = humidity;
+    }
+
+    if (shm) {
+        shm_publish(idx, s);
+    }
+    for (unsigned i = 0; i < AHT20D_MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0 && ((clients[i].subscribed | clients[i].waiting) & bit)) {
+            clients[i].waiting &= ~bit;
+            send_sample(i, s);
+        }
+    }
+}
+
+static void sensors_tick(void) {
+    for (unsigned i = 0; i < nsensors; i++) {
+        struct sensor_state *st = &sensors[i];
+
+        if (st->ready_fd >= 0) {
+            st->overruns++;
+            continue;
+        }
+        errno = 0;
+        st->ready_fd = aht20_sensor_trigger(st->sensor);
+        if (st->ready_fd < 0) {
+            publish(i, errno ? errno : EIO, 0, 0);
+            continue;
+        }
+        if (watch(st->ready_fd, EPOLL_CTL_ADD, EPOLLIN | EPOLLONESHOT, TAG(TAG_SENSOR, i)) < 0) {
+            close(st->ready_fd);
+            st->ready_fd = -1;
+        }
+    }
+}
+
+static void sensor_ready(unsigned i) {
+    struct sensor_state *st = &sensors[i];
+    uint32_t temperature, humidity;
+    int ret;
+
+    errno = 0;
+    ret = aht20_sensor_fetch(st->sensor, st->ready_fd, &temperature, &humidity);
+    if (ret == 1) {
+        // Still busy; the timerfd was re-armed
+        watch(st->ready_fd, EPOLL_CTL_MOD, EPOLLIN | EPOLLONESHOT, TAG(TAG_SENSOR, i));
+        return;
+    }
+    // The fd is closed by aht20_sensor_fetch(), which also drops it from epoll
+    st->ready_fd = -1;
+    publish(i, ret < 0 ? (errno ? errno : EIO) : 0, temperature, humidity);
+}
+
+static void client_request(unsigned i) {
+    struct aht20d_request req;
+    struct aht20d_message msg;
+    uint64_t all = nsensors == 64 ? ~0ULL : (1ULL << nsensors) - 1;
+    ssize_t n;
+
+    n = recv(clients[i].fd, &req, sizeof(req), MSG_DONTWAIT);
+    if (n < 0 && errno == EAGAIN) {
+        return;
+    }
+    if (n <= 0) {
+        client_drop(i);
+        return;
+    }
+    if ((size_t)n != sizeof(req)) {
+        send_error(i, EPROTO);
+        return;
+    }
+
+    switch (req.type) {
+    case AHT20D_REQ_INFO:
+        memset(&msg, 0, sizeof(msg));
+        msg.type = AHT20D_MSG_INFO;
+        msg.info.nsensors = nsensors;
+        msg.info.period_ms = period_ms;
+        if (shm_name) {
+            snprintf(msg.info.shm_name, sizeof(msg.info.shm_name), "%s", shm_name);
+        }
+        client_send(i, &msg);
+        break;
+    case AHT20D_REQ_QUERY:
+        if (req.sensor >= nsensors) {
+            send_error(i, ENODEV);
+        } else if (sensors[req.sensor].last.seq == 0) {
+            clients[i].waiting |= 1ULL << req.sensor;
+        } else {
+            send_sample(i, &sensors[req.sensor].last);
+        }
+        break;
+    case AHT20D_REQ_SUBSCRIBE:
+        if (req.mask & ~all) {
+            send_error(i, ENODEV);
+        } else {
+            clients[i].subscribed |= req.mask;
+        }
+        break;
+    case AHT20D_REQ_UNSUBSCRIBE:
+        clients[i].subscribed &= ~req.mask;
+        break;
+    default:
+        send_error(i, EINVAL);
+        break;
+    }
+}
+
+static void client_accept(int listen_fd) {
+    int fd;
+
+    fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) {
+        perror("accept");
+        return;
+    }
+    for (unsigned i = 0; i < AHT20D_MAX_CLIENTS; i++) {
+        if (clients[i].fd < 0) {
+            memset(&clients[i], 0, sizeof(clients[i]));
+            clients[i].fd = fd;
+            if (watch(fd, EPOLL_CTL_ADD, EPOLLIN, TAG(TAG_CLIENT, i)) < 0) {
+                client_drop(i);
+            }
+            return;
+        }
+    }
+    fprintf(stderr, "aht20d: too many clients\n");
+    close(fd);
+}
+
+// "BUS" or "BUS:MUX:CH"
+static int add_sensor(const char *spec, struct aht20_transport *sim) {
+    char bus[64];
+    const char *colon = strchr(spec, ':');
+    int mux_addr = -1, mux_channel = 0;
+    struct sensor_state *st;
+
+    if (nsensors == AHT20D_MAX_SENSORS) {
+        fprintf(stderr, "aht20d: at most %d sensors\n", AHT20D_MAX_SENSORS);
+        return -1;
+    }
+    if (strlen(spec) >= sizeof(st->spec)) {
+        fprintf(stderr, "aht20d: sensor spec too long: %s\n", spec);
+        return -1;
+    }
+    snprintf(bus, sizeof(bus), "%.*s", colon ? (int)(colon - spec) : (int)strlen(spec), spec);
+    if (colon && sscanf(colon + 1, "%i:%i", &mux_addr, &mux_channel) != 2) {
+        fprintf(stderr, "aht20d: bad sensor %s, expected BUS[:MUX:CH]\n", spec);
+        return -1;
+    }
+
+    st = &sensors[nsensors];
+    if (sim) {
+        st->sensor = aht20_sensor_open_transport(sim, bus, mux_addr, mux_channel);
+    } else {
+        st->sensor = aht20_sensor_open(bus, mux_addr, mux_channel);
+    }
+    if (!st->sensor) {
+        return -1;
+    }
+    strcpy(st->spec, spec);
+    st->ready_fd = -1;
+    nsensors++;
+    return 0;
+}
+
+static int listen_on(const char *path) {
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "aht20d: socket path too long: %s\n", path);
+        return -1;
+    }
+    fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 64) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static struct aht20d_shm *shm_create(const char *name) {
+    struct aht20d_shm *page;
+    int fd;
+
+    fd = shm_open(name, O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("shm_open");
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(*page)) < 0) {
+        perror("ftruncate");
+        close(fd);
+        return NULL;
+    }
+    page = mmap(NULL, sizeof(*page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        perror("mmap");
+        return NULL;
+    }
+    memset(page, 0, sizeof(*page));
+    page->nsensors = nsensors;
+    page->period_ms = period_ms;
+    __atomic_store_n(&page->magic, AHT20D_SHM_MAGIC, __ATOMIC_RELEASE);
+    return page;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [--period MS] [--socket PATH] [--shm NAME] [--sim]\n"
+            "       [--sensor BUS[:MUX:CH]]...\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option opts[] = {
+        { "period", required_argument, NULL, 'p' },
+        { "socket", required_argument, NULL, 's' },
+        { "shm", required_argument, NULL, 'm' },
+        { "sim", no_argument, NULL, 'S' },
+        { "sensor", required_argument, NULL, 'n' },
+        { NULL, 0, NULL, 0 },
+    };
+    const char *specs[AHT20D_MAX_SENSORS];
+    unsigned nspecs = 0;
+    const char *socket_path = AHT20D_SOCKET;
+    struct aht20_transport *sim = NULL;
+    struct itimerspec its;
+    sigset_t mask;
+    int listen_fd, timer_fd, signal_fd;
+    int running = 1;
+    int c;
+
+    while ((c = getopt_long(argc, argv, "p:s:m:Sn:", opts, NULL)) != -1) {
+        switch (c) {
+        case 'p': period_ms = strtoul(optarg, NULL, 0); break;
+        case 's': socket_path = optarg; break;
+        case 'm': shm_name = optarg; break;
+        case 'S':
+            sim = aht20_transport_sim_open(NULL);
+            if (!sim) {
+                return 1;
+            }
+            break;
+        case 'n':
+            if (nspecs == AHT20D_MAX_SENSORS) {
+                fprintf(stderr, "aht20d: at most %d sensors\n", AHT20D_MAX_SENSORS);
+                return 1;
+            }
+            specs[nspecs++] = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc || period_ms == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    for (unsigned i = 0; i < AHT20D_MAX_CLIENTS; i++) {
+        clients[i].fd = -1;
+    }
+    if (nspecs == 0) {
+        specs[nspecs++] = sim ? "sim" : I2C_DEVICE;
+    }
+    for (unsigned i = 0; i < nspecs; i++) {
+        if (add_sensor(specs[i], sim) < 0) {
+            return 1;
+        }
+    }
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    signal_fd = signalfd(-1, &mask, SFD_CLOEXEC);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (epfd < 0 || signal_fd < 0 || timer_fd < 0) {
+        perror("aht20d");
+        return 1;
+    }
+    if (shm_name) {
+        shm = shm_create(shm_name);
+        if (!shm) {
+            return 1;
+        }
+    }
+    listen_fd = listen_on(socket_path);
+    if (listen_fd < 0) {
+        return 1;
+    }
+
+    // First tick right away, then every period
+    its.it_value.tv_sec = 0;
+    its.it_value.tv_nsec = 1;
+    its.it_interval.tv_sec = period_ms / 1000;
+    its.it_interval.tv_nsec = (period_ms % 1000) * 1000000L;
+    timerfd_settime(timer_fd, 0, &its, NULL);
+
+    if (watch(listen_fd, EPOLL_CTL_ADD, EPOLLIN, TAG(TAG_LISTEN, 0)) < 0 ||
+        watch(timer_fd, EPOLL_CTL_ADD, EPOLLIN, TAG(TAG_TIMER, 0)) < 0 ||
+        watch(signal_fd, EPOLL_CTL_ADD, EPOLLIN, TAG(TAG_SIGNAL, 0)) < 0) {
+        return 1;
+    }
+    fprintf(stderr, "aht20d: %u sensors every %u ms on %s\n", nsensors, period_ms, socket_path);
+
+    while (running) {
+        struct epoll_event events[64];
+        uint64_t expirations;
+        int n;
+
+        n = epoll_wait(epfd, events, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+        for (int k = 0; k < n; k++) {
+            unsigned idx = (uint32_t)events[k].data.u64;
+
+            switch (events[k].data.u64 >> 32) {
+            case TAG_LISTEN:
+                client_accept(listen_fd);
+                break;
+            case TAG_TIMER:
+                if (read(timer_fd, &expirations, sizeof(expirations)) > 0) {
+                    sensors_tick();
+                }
+                break;
+            case TAG_SIGNAL:
+                running = 0;
+                break;
+            case TAG_SENSOR:
+                sensor_ready(idx);
+                break;
+            case TAG_CLIENT:
+                if (clients[idx].fd >= 0) {
+                    client_request(idx);
+                }
+                break;
+            }
+        }
+    }
+
+    for (unsigned i = 0; i < nsensors; i++) {
+        if (sensors[i].overruns) {
+            fprintf(stderr, "aht20d: %s skipped %lu periods\n", sensors[i].spec, sensors[i].overruns);
+        }
+        if (sensors[i].ready_fd >= 0) {
+            close(sensors[i].ready_fd);
+        }
+        aht20_sensor_close(sensors[i].sensor);
+    }
+    for (unsigned i = 0; i < AHT20D_MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0) {
+            client_drop(i);
+        }
+    }
+    close(listen_fd);
+    unlink(socket_path);
+    if (shm) {
+        munmap(shm, sizeof(*shm));
+        shm_unlink(shm_name);
+    }
+    if (sim) {
+        struct aht20_sim_stats stats;
+
+        aht20_transport_sim_stats(sim, &stats);
+        fprintf(stderr, "aht20d: sim %llu triggers, %llu frames (%llu busy), %llu I2C messages\n",
+                (unsigned long long)stats.triggers, (unsigned long long)stats.frames,
+                (unsigned long long)stats.busy_frames, (unsigned long long)sim->stats.msgs);
+        aht20_transport_close(sim);
+    }
+    return 0;
+}
@@ -6,260 +6,720 @@
 #include <linux/uaccess.h>
 #include <linux/ioctl.h>
 #include <linux/delay.h>
+#include <linux/atomic.h>
+#include <linux/ktime.h>
+#include <linux/string.h>
+#include <linux/mutex.h>
+#include <linux/kfifo.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/workqueue.h>
+#include <linux/jiffies.h>
+#include <linux/cdev.h>
+#include <linux/idr.h>
+#include <linux/kref.h>
+#include <linux/rwsem.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/sort.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/overflow.h>
+#include <linux/iio/iio.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/trigger_consumer.h>
+#include <linux/iio/triggered_buffer.h>
+
+#include "aht20_ioctl.h"
+#include "aht20_proto.h"    // AHT20_lib/include, dung chung voi libaht20
+
+#define CREATE_TRACE_POINTS
+#include "aht20_trace.h"
 
 
 #define DEVICE_NAME "aht20_dev"
 #define CLASS_NAME  "aht20_class"
+#define AHT20_MAX_DEVICES 256       // so minor dang ky: /dev/aht20_dev0..255
 
-#define AHT20_IOCTL_MAGIC 'A'
-#define AHT20_IOCTL_MAGIC1 'B'
-#define AHT20_READ_TEMPERATURE _IOR(AHT20_IOCTL_MAGIC, 1, uint32_t)
-#define AHT20_READ_HUMIDITY _IOR(AHT20_IOCTL_MAGIC1, 0, uint32_t)
-#define AHT20_START _IO(AHT20_IOCTL_MAGIC, 2)
-#define AHT20_STOP _IO(AHT20_IOCTL_MAGIC, 3)
-
-// Read
+// Read (lenh 0xAC/0x71/0xBE/0xBA va bit status nam trong aht20_proto.h)
 #define AHT20_ADDR 0x38
-#define AHT20_CMD_MEASURE 0xAC
-#define AHT20_CMD_STATUS 0x71
-#define AHT20_CMD_INIT 0xBE
-//#define AHT20_CMD_SOFT_RESET 0xBA  // Soft reset command
 #define AHT20_CMD_MEASURE_STOP 0x00 //stop
 
-// Khai bao bien
-static int major_number;
-static struct class* aht20_class = NULL;
-static struct device* aht20_device = NULL;
-static struct i2c_client* aht20_client;
+// Thoi gian (datasheet: chuyen doi ~80ms, init 10ms)
+#define AHT20_INIT_DELAY_US 10000
+#define AHT20_CONV_MIN_US 75000     // ngu truoc lan poll dau tien
+#define AHT20_POLL_US 2000          // khoang cach giua cac lan poll
+#define AHT20_POLL_SLACK_US 500
+#define AHT20_CONV_TIMEOUT_MS 200   // deadline tu luc trigger
+#define AHT20_SOFT_RESET_US 20000   // datasheet: 0xBA xong trong 20ms
+
+// Phuc hoi loi trong mot lan chuyen doi (xem aht20_convert)
+#define AHT20_RECOVERY_DEFAULT_MS 500
+#define AHT20_RECOVERY_MAX_MS 10000
+#define AHT20_RESET_AFTER 2         // so loi truoc khi soft reset
+
+// Oversampling va loc
+#define AHT20_MAX_OVERSAMPLE 16
+#define AHT20_IIR_MAX_SHIFT 7
+#define AHT20_IIR_DEFAULT_SHIFT 2
+
+// Background sampler
+#define AHT20_FIFO_SIZE 64          // so mau, phai la luy thua cua 2
+#define AHT20_MIN_PERIOD_MS 100     // khong nhanh hon mot lan chuyen doi
+#define AHT20_EVENT_FIFO_SIZE 32    // su kien nguong chua doc
+
+// Bo dem hieu nang, xem trong /sys/class/aht20_class/aht20_devN/stats/
+// va histogram do tre trong /sys/kernel/debug/aht20/aht20_devN/latency
+enum aht20_phase {
+    AHT20_PH_STATUS,
+    AHT20_PH_TRIGGER,
+    AHT20_PH_WAIT,
+    AHT20_PH_FETCH,
+    AHT20_PH_COUNT,
+};
+
+#define AHT20_HIST_BUCKETS 24       // bucket k: [2^(k-1), 2^k) us, bucket cuoi gom phan con lai
+
+// Chi ghi khi giu data->lock, doc khong khoa (READ_ONCE)
+struct aht20_stats {
+    unsigned long reads;            // so lan aht20_read_sample
+    unsigned long crc_errors;
+    unsigned long busy_retries;     // frame con bit busy, phai poll lai
+    unsigned long i2c_errors;
+    unsigned long reinits;          // gui 0xBE vi status bao chua/mat calibration
+    unsigned long status_skips;     // bo qua 0x71 nho da biet calibrated
+    unsigned long cache_hits;       // AHT20_READ_CACHED tra mau con du moi
+    unsigned long coalesced;        // dung chung ket qua cua lan do dang chay
+    unsigned long events;           // su kien nguong da xep hang
+    unsigned long event_drops;      // su kien bi bo vi hang doi day
+    unsigned long retriggers;       // trigger lai sau sai CRC, NAK hoac busy qua lau
+    unsigned long soft_resets;      // gui 0xBA roi khoi tao lai
+    unsigned long bus_recoveries;   // i2c_recover_bus() khi reset khong du
+    unsigned long recovered;        // lan chuyen doi thanh cong sau it nhat mot loi
+    unsigned long recovery_failures; // het deadline hoac het buoc phuc hoi
+    u32 hist[AHT20_PH_COUNT][AHT20_HIST_BUCKETS];
+};
+
+// Nguong cua mot kenh va trang thai hien tai (dang vuot hay khong)
+struct aht20_thresh {
+    struct aht20_threshold cfg;
+    bool high_active;
+    bool low_active;
+};
 
+// Phan chardev cua mot cam bien. aht20_data la devm nen bi giai phong ngay sau
+// remove, con fd da mo thi song lau hon: probe giu mot tham chieu, moi open giu
+// mot tham chieu, fd cuoi cung dong thi giai phong. Sau remove dead = true,
+// data = NULL va moi thao tac tren fd cu tra ve -ENODEV.
+struct aht20_chrdev {
+    struct kref ref;
+    struct cdev *cdev;              // cdev_alloc: kobject rieng, tu giai phong
+    int minor;
+    struct rw_semaphore rwsem;      // fop giu doc khi dung data, remove giu ghi
+    bool dead;
+    struct aht20_data *data;
+    wait_queue_head_t wq;           // fifo mau va su kien nguong
+    struct fasync_struct *fasync;
+};
 
-uint32_t humidity;
-uint32_t temperature;
+// Trang thai cua mot cam bien
+struct aht20_data {
+    struct i2c_client *client;
+    struct aht20_chrdev *chrdev;
+    struct device *dev;             // /dev/aht20_dev<minor>
+    int minor;
+    struct mutex lock;              // giu trong suot mot lan do tren bus
+    bool calibrated;
+    u32 seq;
+    struct aht20_timings last_timings;
+    struct aht20_shared *shared;    // trang mmap, chi driver ghi
+    struct aht20_stats stats;
+    struct dentry *debugfs;
+    unsigned int recovery_ms;       // 0 = loi dau tien tra ve ngay
+
+    // Oversampling/loc, chi doi khi giu data->lock
+    unsigned int oversample;        // 1, 2, 4, 8, 16 lan chuyen doi moi mau
+    unsigned int filter;            // AHT20_FILTER_*
+    unsigned int iir_shift;
+    bool iir_valid;
+    u32 iir_temperature;            // raw << 8
+    u32 iir_humidity;
+
+    // Sampler dinh ky: work ghi vao fifo, read() lay ra
+    struct mutex cfg_lock;          // doi period/watermark
+    bool shutdown;                  // remove da chay, khong len lich work nua
+    struct delayed_work work;
+    unsigned int period_ms;         // 0 = tat
+    unsigned long next_jiffies;
+    unsigned int watermark;         // poll() bao POLLIN khi co >= watermark mau
+    u32 overruns;                   // so mau bi bo vi fifo day
+    struct mutex read_lock;         // chi mot reader lay fifo mot luc
+    DECLARE_KFIFO(fifo, struct aht20_sample, AHT20_FIFO_SIZE);
+
+    // Su kien nguong, bao ve boi event_lock; dung chung chrdev->wq voi fifo mau
+    spinlock_t event_lock;
+    struct aht20_thresh thresh[AHT20_CHAN_COUNT];
+    DECLARE_KFIFO(events, struct aht20_event, AHT20_EVENT_FIFO_SIZE);
+};
 
+// Khai bao bien: chi dung chung vung chrdev va class, moi cam bien co aht20_data rieng
+static dev_t aht20_devt;
+static struct class* aht20_class = NULL;
+static DEFINE_IDR(aht20_minors);          // minor -> aht20_chrdev, open tim o day
+static DEFINE_MUTEX(aht20_minors_lock);
+static struct dentry *aht20_debugfs;        // /sys/kernel/debug/aht20
 
 
 // Khai bao ham
 static int aht20_open(struct inode *inodep, struct file *filep);
 static int aht20_release(struct inode *inodep, struct file *filep);
-static int aht20_read_temperature(struct i2c_client *client, uint32_t *temperature);
-static int aht20_read_humidity(struct i2c_client *client, uint32_t *humidity);
+static int aht20_read_temperature(struct aht20_data *data, uint32_t *temperature);
+static int aht20_read_humidity(struct aht20_data *data, uint32_t *humidity);
+static int aht20_read_sample(struct aht20_data *data, struct aht20_sample *sample);
 static long aht20_ioctl(struct file *filep, unsigned int cmd, unsigned long arg);
+static ssize_t aht20_read(struct file *filep, char __user *buf, size_t len, loff_t *off);
+static __poll_t aht20_poll(struct file *filep, poll_table *wait);
+static int aht20_mmap(struct file *filep, struct vm_area_struct *vma);
+
+
+// Cac pha cua mot lan do
+enum aht20_state {
+    AHT20_ST_STATUS,    // 0x71, doc byte status
+    AHT20_ST_INIT,      // 0xBE neu chua calibrated
+    AHT20_ST_TRIGGER,   // 0xAC 0x33 0x00
+    AHT20_ST_WAIT,      // ngu toi lan poll ke tiep
+    AHT20_ST_FETCH,     // doc frame 7 byte, kiem tra bit busy cua chinh frame do
+    AHT20_ST_DONE,
+};
 
-
-// ham CRC
-static u8 crc8(const u8 *data, int len)
+static void aht20_hist_add(struct aht20_data *data, enum aht20_phase phase, u32 us)
 {
-    u8 crc = 0xFF;
-    int i, j;
+    unsigned int bucket = min_t(unsigned int, fls(us), AHT20_HIST_BUCKETS - 1);
 
-    for (i = 0; i < len; i++) {
-        crc ^= data[i];
-        for (j = 0; j < 8; j++) {
-            if (crc & 0x80)
-                crc = (crc << 1) ^ 0x31;  // Polynomial: x^8 + x^5 + x^4 + 1
-            else
-                crc <<= 1;
-        }
-    }
-    return crc;
+    WRITE_ONCE(data->stats.hist[phase][bucket], data->stats.hist[phase][bucket] + 1);
 }
 
-// Ham read temperature
-static int aht20_read_temperature(struct i2c_client *client, uint32_t *temperature)
+static void aht20_stat_inc(unsigned long *counter)
+{
+    WRITE_ONCE(*counter, *counter + 1);
+}
+
+// Ham do: trigger 0xAC roi poll bit busy cua frame tra ve cho toi deadline.
+// Bo qua 0x71 khi da biet cam bien calibrated. handshake: chi chay 0x71 (va
+// 0xBE neu can) roi dung truoc trigger. Goi khi dang giu data->lock.
+static int aht20_run(struct aht20_data *data, u8 *buf, struct aht20_timings *t, bool handshake)
 {
+    struct i2c_client *client = data->client;
+    enum aht20_state state = data->calibrated && !handshake ? AHT20_ST_TRIGGER : AHT20_ST_STATUS;
+    bool probed = state == AHT20_ST_STATUS;
+    ktime_t start, phase, deadline = 0, now;
+    unsigned int delay_us;
     u8 cmd[3];
-    u8 buf[7];
     int ret;
-    u8 crc;
-    int tem;
 
-    msleep(100); // cho 100ms
+    memset(t, 0, sizeof(*t));
+    start = phase = ktime_get();
+    if (state == AHT20_ST_TRIGGER)
+        aht20_stat_inc(&data->stats.status_skips);
 
-    // Bước 1: Kiểm tra trạng thái cảm biến
-    cmd[0] = AHT20_CMD_STATUS; //0x71, byte status
-    ret = i2c_master_send(client, cmd, 1); // gui lenh kiem tra trang thai
-    if (ret < 0) {
-        printk(KERN_ERR "Failed to send status command\n");
-        return ret;
-    }
-    
-    msleep(100); // cho 100ms
+    while (state != AHT20_ST_DONE) {
+        switch (state) {
+        case AHT20_ST_STATUS:
+            cmd[0] = AHT20_CMD_STATUS;
+            ret = i2c_master_send(client, cmd, 1);
+            if (ret < 0) {
+                aht20_stat_inc(&data->stats.i2c_errors);
+                printk_ratelimited(KERN_ERR "Failed to send status command\n");
+                return ret;
+            }
+            ret = i2c_master_recv(client, buf, 1);
+            if (ret < 0) {
+                aht20_stat_inc(&data->stats.i2c_errors);
+                printk_ratelimited(KERN_ERR "Failed to read status\n");
+                return ret;
+            }
+            now = ktime_get();
+            t->status_us = ktime_us_delta(now, phase);
+            aht20_hist_add(data, AHT20_PH_STATUS, t->status_us);
+            phase = now;
+            if ((buf[0] & AHT20_STATUS_CALIBRATED) == AHT20_STATUS_CALIBRATED) {
+                data->calibrated = true;
+                state = AHT20_ST_TRIGGER;
+            } else {
+                state = AHT20_ST_INIT;
+            }
+            break;
 
-    ret = i2c_master_recv(client, buf, 1); // Doc du lieu tu byte status
-    if (ret < 0) {
-        printk(KERN_ERR "Failed to read status\n");
-        return ret;
-    }
-    
+        case AHT20_ST_INIT:
+            cmd[0] = AHT20_CMD_INIT; //0xBE khoi tao gom thanh ghi 0x1B, 0x1C, 0x1E
+            cmd[1] = 0x08;
+            cmd[2] = 0x00;
+            aht20_stat_inc(&data->stats.reinits);
+            ret = i2c_master_send(client, cmd, 3);
+            if (ret < 0) {
+                aht20_stat_inc(&data->stats.i2c_errors);
+                printk_ratelimited(KERN_ERR "Failed to initialize sensor\n");
+                return ret;
+            }
+            usleep_range(AHT20_INIT_DELAY_US, AHT20_INIT_DELAY_US + 1000);
+            now = ktime_get();
+            t->init_us = ktime_us_delta(now, phase);
+            phase = now;
+            data->calibrated = true;
+            state = AHT20_ST_TRIGGER;
+            break;
 
-    if ((buf[0] & 0x18) != 0x18) {
-        // Cảm biến cần khởi tạo
-        cmd[0] = AHT20_CMD_INIT; //0xBE khoi tao gom thanh ghi 0x1B, 0x1C, 0x1E
-        cmd[1] = 0x08; // byte cai dat cac che do or cau hinh them
-        cmd[2] = 0x00; // byte bo sung
-        ret = i2c_master_send(client, cmd, 3); // Gui du lieu khoi tao lai cam bien
-        if (ret < 0) {
-            printk(KERN_ERR "Failed to initialize sensor\n");
-            return ret;
+        case AHT20_ST_TRIGGER:
+            if (handshake) {
+                state = AHT20_ST_DONE;
+                break;
+            }
+            cmd[0] = AHT20_CMD_MEASURE; //0xAC
+            cmd[1] = 0x33;
+            cmd[2] = 0x00;
+            ret = i2c_master_send(client, cmd, 3);
+            if (ret < 0) {
+                aht20_stat_inc(&data->stats.i2c_errors);
+                printk_ratelimited(KERN_ERR "Failed to send measurement command\n");
+                return ret;
+            }
+            now = ktime_get();
+            t->trigger_us = ktime_us_delta(now, phase);
+            aht20_hist_add(data, AHT20_PH_TRIGGER, t->trigger_us);
+            trace_aht20_trigger(data->minor, probed);
+            phase = now;
+            deadline = ktime_add_ms(now, AHT20_CONV_TIMEOUT_MS);
+            state = AHT20_ST_WAIT;
+            break;
+
+        case AHT20_ST_WAIT:
+            // Lan dau cho gan het thoi gian chuyen doi, sau do poll buoc nho
+            delay_us = t->polls ? AHT20_POLL_US : AHT20_CONV_MIN_US;
+            usleep_range(delay_us, delay_us + AHT20_POLL_SLACK_US);
+            state = AHT20_ST_FETCH;
+            break;
+
+        case AHT20_ST_FETCH:
+            now = ktime_get();
+            ret = i2c_master_recv(client, buf, AHT20_FRAME_LEN);  // Đọc 7 byte, bao gồm cả CRC
+            if (ret < 0) {
+                aht20_stat_inc(&data->stats.i2c_errors);
+                printk_ratelimited(KERN_ERR "Failed to read data\n");
+                return ret;
+            }
+            if (ret != AHT20_FRAME_LEN) {
+                aht20_stat_inc(&data->stats.i2c_errors);
+                return -EIO;
+            }
+            t->polls++;
+
+            if (buf[0] & AHT20_STATUS_BUSY) {
+                aht20_stat_inc(&data->stats.busy_retries);
+                trace_aht20_retry(data->minor, t->polls, ktime_us_delta(now, phase));
+                if (ktime_after(ktime_get(), deadline)) {
+                    printk_ratelimited(KERN_ERR "Sensor is busy\n");
+                    return -ETIMEDOUT;
+                }
+                state = AHT20_ST_WAIT;
+                break;
+            }
+
+            t->wait_us = ktime_us_delta(now, phase);
+            phase = ktime_get();
+            t->fetch_us = ktime_us_delta(phase, now);
+            aht20_hist_add(data, AHT20_PH_WAIT, t->wait_us);
+            aht20_hist_add(data, AHT20_PH_FETCH, t->fetch_us);
+            state = AHT20_ST_DONE;
+            break;
+
+        default:
+            return -EINVAL;
         }
-        msleep(10); // cho 10ms
     }
 
-    // Bước 2: Kích hoạt đo lường
-    cmd[0] = AHT20_CMD_MEASURE; //0xAC
-    cmd[1] = 0x33;
-    cmd[2] = 0x00;
-    ret = i2c_master_send(client, cmd, 3); // gui lenh kich hoat do luong
-    if (ret < 0) {
-        printk(KERN_ERR "Failed to send measurement command\n");
-        return ret;
-    }
+    t->total_us = ktime_us_delta(phase, start);
+    return 0;
+}
+
+static int aht20_measure(struct aht20_data *data, u8 *buf, struct aht20_timings *t)
+{
+    return aht20_run(data, buf, t, false);
+}
 
-    msleep(80);// cho 80ms 
+// Ham kiem tra calibration mot lan: 0x71, gui 0xBE chi khi status bao can.
+// Sau do data->calibrated giu ket qua, lan do sau chi con trigger + fetch.
+static int aht20_handshake(struct aht20_data *data)
+{
+    struct aht20_timings t;
+    u8 buf[AHT20_FRAME_LEN];
 
-    // Kiểm tra nếu cảm biến đang bận
-    if (buf[0] & 0x80) {
-        printk(KERN_ERR "Sensor is busy\n"); // kiem tra bit[7] cua byte status
-        return -EAGAIN;                      // 1 busy, 0 idle: ngu dong
-    }
+    return aht20_run(data, buf, &t, true);
+}
+
+// Ghi mau moi nhat vao trang mmap. Mot writer duy nhat vi dang giu data->lock.
+static void aht20_publish(struct aht20_data *data, const struct aht20_sample *sample)
+{
+    struct aht20_shared *sh = data->shared;
 
-    // Bước 3: Đọc dữ liệu
-    ret = i2c_master_recv(client, buf, 7);  // Đọc 7 byte, bao gồm cả CRC
+    WRITE_ONCE(sh->lock_seq, sh->lock_seq + 1);
+    smp_wmb();
+    sh->sample = *sample;
+    smp_wmb();
+    WRITE_ONCE(sh->lock_seq, sh->lock_seq + 1);
+}
+
+// Gui 0xBA: cam bien khoi dong lai, lan do sau hoi lai 0x71 va gui 0xBE
+static int aht20_soft_reset(struct aht20_data *data)
+{
+    u8 cmd = AHT20_CMD_SOFT_RESET;
+    int ret;
+
+    data->calibrated = false;
+    ret = i2c_master_send(data->client, &cmd, 1);
     if (ret < 0) {
-        printk(KERN_ERR "Failed to read data\n");
+        aht20_stat_inc(&data->stats.i2c_errors);
+        printk_ratelimited(KERN_ERR "Failed to send soft reset\n");
         return ret;
     }
+    // Chi dem khi 0xBA da duoc gui
+    aht20_stat_inc(&data->stats.soft_resets);
+    usleep_range(AHT20_SOFT_RESET_US, AHT20_SOFT_RESET_US + 1000);
+    return 0;
+}
 
-    
+// Phuc hoi bus o adapter goc: adapter con cua mux khong co bus_recovery_info.
+// Giu khoa bus de khong chen vao giua giao dich cua thiet bi khac.
+static int aht20_recover_bus(struct aht20_data *data)
+{
+    struct i2c_adapter *root = i2c_root_adapter(&data->client->adapter->dev);
+    int ret;
+
+    if (!root)
+        return -ENODEV;
+    aht20_stat_inc(&data->stats.bus_recoveries);
+    i2c_lock_bus(root, I2C_LOCK_ROOT_ADAPTER);
+    ret = i2c_recover_bus(root);
+    i2c_unlock_bus(root, I2C_LOCK_ROOT_ADAPTER);
+    return ret;
+}
+
+// Mot lan do va kiem tra frame
+static int aht20_convert_once(struct aht20_data *data, struct aht20_reading *r)
+{
+    struct aht20_timings t;
+    u8 buf[AHT20_FRAME_LEN];
+    int ret;
 
-    // Tính toán và kiểm tra CRC
-    crc = crc8(buf, 6);  // CRC được tính toán trên 6 byte đầu
-    if (crc != buf[6]) {
-        printk(KERN_ERR "CRC check failed\n");
+    ret = aht20_measure(data, buf, &t);
+    if (ret < 0)
+        return ret;
+    data->last_timings = t;
+
+    // Kiểm tra CRC va tach ca hai kenh tu cung mot frame
+    switch (aht20_decode_frame(buf, r)) {
+    case AHT20_FRAME_OK:
+        trace_aht20_complete(data->minor, r->status, r->raw_temperature, r->raw_humidity,
+                             t.total_us, t.polls);
+        break;
+    case AHT20_FRAME_BUSY:
+        printk_ratelimited(KERN_ERR "Sensor is busy\n");
+        return -EAGAIN;
+    default:
+        aht20_stat_inc(&data->stats.crc_errors);
+        trace_aht20_crc_error(data->minor, buf[0], buf[6], aht20_crc8(buf, 6));
+        printk_ratelimited(KERN_ERR "CRC check failed\n");
         return -EIO;
     }
 
-    // Tính toán nhiệt độ
-    tem = ((buf[3] & 0xF) << 16) | (buf[4] << 8) | buf[5]; // tong co 20bit
-    // buf[3] & 00001111 de lay 4 bit cuoi, dich trai 16 lan de 4 bit vao 4 bit dau cua tem
-    // buf [4] lay 8 bit, dich trai 8 lan de vao 8 bit ke  tiep
-    // buf [5] lay 8 bit, vao 8 bit cuoi cua tem
-    *temperature = ((tem * 2000) / 1048576) - 500;// 1048576 = 2^20 0x100000
-    // tinh theo cong thuc T = (()S_T/2^20)* 200 -50)*10
-    tem = *temperature;
-    printk(KERN_INFO "AHT20 Read - Temperature: %d.%d\n", tem/10, tem % 10);
+    // Frame cho biet cam bien mat calibration (vd sau brown-out): lan sau hoi lai 0x71
+    if ((r->status & AHT20_STATUS_CALIBRATED) != AHT20_STATUS_CALIBRATED)
+        data->calibrated = false;
     return 0;
 }
 
-// Ham read humidity
-static int aht20_read_humidity(struct i2c_client *client, uint32_t *humidity)
+// Ham do: mot lan chuyen doi cho ca nhiet do va do am, phuc hoi loi trong
+// data->recovery_ms thay vi bat caller lam lai tu dau:
+//  - frame con busy: aht20_run da doc lai frame, khong trigger lai
+//  - sai CRC, NAK hoac busy qua AHT20_CONV_TIMEOUT_MS: trigger lai
+//  - loi thu AHT20_RESET_AFTER: soft reset 0xBA, lan sau 0x71 + 0xBE
+//  - van loi sau reset: i2c_recover_bus() (9 xung SCL + STOP) roi reset lai
+// Moi buoc chi chay khi con du thoi gian cho mot lan chuyen doi.
+// Goi khi dang giu data->lock.
+static int aht20_convert(struct aht20_data *data, struct aht20_reading *r)
 {
-    u8 cmd[3];
-    u8 buf[7];
+    ktime_t deadline = ktime_add_ms(ktime_get(), READ_ONCE(data->recovery_ms));
+    bool reset = false, bus_recovered = false;
+    unsigned int faults = 0;
+    s64 need_us;
     int ret;
-    u8 crc;
-    int hum;
 
-    msleep(100);
-    // Bước 1: Kiểm tra trạng thái cảm biến
-    cmd[0] = AHT20_CMD_STATUS; // 0x71
-    ret = i2c_master_send(client, cmd, 1);
-    if (ret < 0) {
-        printk(KERN_ERR "Failed to send status command\n");
-        return ret;
-    }
-    
-    msleep(100);
+    for (;;) {
+        ret = aht20_convert_once(data, r);
+        if (ret == 0)
+            break;
 
-    ret = i2c_master_recv(client, buf, 1);
-    if (ret < 0) {
-        printk(KERN_ERR "Failed to read status\n");
-        return ret;
-    }
-    
-    if ((buf[0] & 0x18) != 0x18) {
-        // Cảm biến cần khởi tạo
-        cmd[0] = AHT20_CMD_INIT;
-        cmd[1] = 0x08;
-        cmd[2] = 0x00;
-        ret = i2c_master_send(client, cmd, 3);
-        if (ret < 0) {
-            printk(KERN_ERR "Failed to initialize sensor\n");
+        faults++;
+        need_us = AHT20_CONV_MIN_US;
+        if (faults >= AHT20_RESET_AFTER)
+            need_us += AHT20_SOFT_RESET_US + AHT20_INIT_DELAY_US;
+        if (bus_recovered || ktime_after(ktime_add_us(ktime_get(), need_us), deadline)) {
+            if (READ_ONCE(data->recovery_ms))
+                aht20_stat_inc(&data->stats.recovery_failures);
             return ret;
         }
-        msleep(10);
+
+        if (faults < AHT20_RESET_AFTER) {
+            aht20_stat_inc(&data->stats.retriggers);
+        } else {
+            if (!reset) {
+                reset = true;
+                if (aht20_soft_reset(data) == 0)
+                    continue;
+                // 0xBA bi NAK: bus co the dang treo, phuc hoi bus ngay
+            }
+            bus_recovered = true;
+            ret = aht20_recover_bus(data);
+            if (ret < 0 && ret != -EOPNOTSUPP)
+                printk_ratelimited(KERN_WARNING "I2C bus recovery failed: %d\n", ret);
+            aht20_soft_reset(data);
+        }
     }
 
-    // Bước 2: Kích hoạt đo lường
-    cmd[0] = AHT20_CMD_MEASURE;
-    cmd[1] = 0x33;
-    cmd[2] = 0x00;
-    ret = i2c_master_send(client, cmd, 3);
-    if (ret < 0) {
-        printk(KERN_ERR "Failed to send measurement command\n");
-        return ret;
+    if (faults)
+        aht20_stat_inc(&data->stats.recovered);
+    return 0;
+}
+
+// Phuong sai cua trung binh n gia tri (don vi^2): s^2 / n, 0 khi n = 1
+static u32 aht20_mean_var(const s32 *milli, unsigned int n)
+{
+    s64 sum = 0;
+    u64 sq = 0;
+    s32 mean;
+    unsigned int i;
+
+    if (n < 2)
+        return 0;
+
+    for (i = 0; i < n; i++)
+        sum += milli[i];
+    mean = div_s64(sum, n);
+    for (i = 0; i < n; i++) {
+        s64 d = milli[i] - mean;
+
+        sq += d * d;
     }
+    return min_t(u64, div_u64(sq, (n - 1) * n), U32_MAX);
+}
+
+static int aht20_cmp_u32(const void *a, const void *b)
+{
+    u32 x = *(const u32 *)a, y = *(const u32 *)b;
 
-    msleep(80);
+    return (x > y) - (x < y);
+}
 
-    // Kiểm tra nếu cảm biến đang bận
-    if (buf[0] & 0x80) {
-        printk(KERN_ERR "Sensor is busy\n");// kiem tra bit[7] cua status 
-        return -EAGAIN;
+// Loc n gia tri tho cua mot kenh theo data->filter, tra ve gia tri tho da loc.
+// *iir la trang thai IIR cua kenh (raw << 8).
+static u32 aht20_filter_channel(struct aht20_data *data, u32 *raw, unsigned int n,
+                                bool temperature, u32 *iir, u32 *var)
+{
+    s32 milli[AHT20_MAX_OVERSAMPLE];
+    u32 sum = 0, mean, mean_var;
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        milli[i] = temperature ? aht20_temp_milli(raw[i]) : (s32)aht20_hum_milli(raw[i]);
+        sum += raw[i];
+    }
+    mean = sum / n;
+    mean_var = aht20_mean_var(milli, n);
+
+    switch (data->filter) {
+    case AHT20_FILTER_MEDIAN:
+        sort(raw, n, sizeof(*raw), aht20_cmp_u32, NULL);
+        // Trung vi cua nhieu Gauss: phuong sai ~ pi/2 lan cua trung binh
+        *var = mult_frac(mean_var, 157, 100);
+        return n & 1 ? raw[n / 2] : (raw[n / 2 - 1] + raw[n / 2]) / 2;
+    case AHT20_FILTER_IIR:
+        if (!data->iir_valid)
+            *iir = mean << 8;
+        else
+            *iir += ((s32)(mean << 8) - (s32)*iir) >> data->iir_shift;
+        // He so a = 1/2^k: phuong sai dau ra = a / (2 - a) lan dau vao
+        *var = mean_var / ((2U << data->iir_shift) - 1);
+        return (*iir + 128) >> 8;
+    default:
+        *var = mean_var;
+        return mean;
     }
+}
 
-    // Bước 3: Đọc dữ liệu
-    ret = i2c_master_recv(client, buf, 7);  // Đọc 7 byte, bao gồm cả CRC
-    if (ret < 0) {
-        printk(KERN_ERR "Failed to read data\n");
-        return ret;
+// Mot mau bao cao: data->oversample lan chuyen doi, loc thanh mot gia tri
+static int aht20_read_sample_locked(struct aht20_data *data, struct aht20_sample *sample)
+{
+    u32 raw_t[AHT20_MAX_OVERSAMPLE], raw_h[AHT20_MAX_OVERSAMPLE];
+    unsigned int i, n = data->oversample;
+    struct aht20_reading r;
+    u32 var_t, var_h;
+    int ret;
+
+    aht20_stat_inc(&data->stats.reads);
+    for (i = 0; i < n; i++) {
+        ret = aht20_convert(data, &r);
+        if (ret < 0)
+            return ret;
+        raw_t[i] = r.raw_temperature;
+        raw_h[i] = r.raw_humidity;
     }
 
+    memset(sample, 0, sizeof(*sample));
+    sample->raw_temperature = aht20_filter_channel(data, raw_t, n, true,
+                                                   &data->iir_temperature, &var_t);
+    sample->raw_humidity = aht20_filter_channel(data, raw_h, n, false,
+                                                &data->iir_humidity, &var_h);
+    data->iir_valid = true;
+
+    sample->version = AHT20_SAMPLE_VERSION;
+    sample->seq = ++data->seq;
+    sample->timestamp_ns = ktime_get_ns();
+    sample->status = r.status;              // frame cuoi cung
+    sample->temperature = aht20_temp_deci(sample->raw_temperature);    // 0.1 do C
+    sample->humidity = aht20_hum_deci(sample->raw_humidity);           // 0.1 %RH
+    sample->temperature_var = var_t;
+    sample->humidity_var = var_h;
+    sample->oversample = n;
+    sample->filter = data->filter;
+    aht20_publish(data, sample);
+    return 0;
+}
+
+// Doi che do loc; trang thai IIR bat dau lai tu mau ke tiep
+static int aht20_set_filter(struct aht20_data *data, const struct aht20_filter *f)
+{
+    if (!is_power_of_2(f->oversample) || f->oversample > AHT20_MAX_OVERSAMPLE)
+        return -EINVAL;
+    if (f->mode > AHT20_FILTER_IIR)
+        return -EINVAL;
+    if (f->mode == AHT20_FILTER_IIR &&
+        (f->iir_shift < 1 || f->iir_shift > AHT20_IIR_MAX_SHIFT))
+        return -EINVAL;
+
+    mutex_lock(&data->lock);
+    data->oversample = f->oversample;
+    data->filter = f->mode;
+    if (f->mode == AHT20_FILTER_IIR)
+        data->iir_shift = f->iir_shift;
+    data->iir_valid = false;
+    mutex_unlock(&data->lock);
+    return 0;
+}
 
-    // Tính toán và kiểm tra CRC
-    crc = crc8(buf, 6);  // CRC được tính toán trên 6 byte đầu
-    if (crc != buf[6]) {
-        printk(KERN_ERR "CRC check failed\n");
-        return -EIO;
+static void aht20_get_filter(struct aht20_data *data, struct aht20_filter *f)
+{
+    memset(f, 0, sizeof(*f));
+    mutex_lock(&data->lock);
+    f->oversample = data->oversample;
+    f->mode = data->filter;
+    f->iir_shift = data->iir_shift;
+    mutex_unlock(&data->lock);
+}
+
+static int aht20_read_sample(struct aht20_data *data, struct aht20_sample *sample)
+{
+    int ret;
+
+    mutex_lock(&data->lock);
+    ret = aht20_read_sample_locked(data, sample);
+    mutex_unlock(&data->lock);
+    return ret;
+}
+
+// Ham doc co cache. Mau trong trang mmap la mau moi nhat va chi duoc ghi khi
+// giu data->lock. Caller phai cho khoa trong luc mot lan do khac dang chay se
+// lay luon ket qua cua lan do do neu no xong sau luc caller bat dau, nen N
+// caller cung luc chi ton mot lan chuyen doi. max_age_ms > 0: chap nhan ca
+// mau cu hon, mien khong qua max_age_ms.
+static int aht20_read_cached(struct aht20_data *data, u32 max_age_ms,
+                             struct aht20_sample *sample, u32 *flags)
+{
+    const struct aht20_sample *last = &data->shared->sample;
+    s64 start = ktime_get_ns();
+    u32 hit = 0;
+    int ret = 0;
+
+    mutex_lock(&data->lock);
+    if (last->version) {
+        if (last->timestamp_ns >= start) {
+            aht20_stat_inc(&data->stats.coalesced);
+            hit = AHT20_CACHED_SHARED;
+        } else if (start - last->timestamp_ns <= (s64)max_age_ms * NSEC_PER_MSEC) {
+            aht20_stat_inc(&data->stats.cache_hits);
+            hit = AHT20_CACHED_HIT;
+        }
     }
+    if (hit)
+        *sample = *last;
+    else
+        ret = aht20_read_sample_locked(data, sample);
+    mutex_unlock(&data->lock);
+
+    if (flags)
+        *flags = hit;
+    return ret;
+}
+
+// Ham read temperature
+static int aht20_read_temperature(struct aht20_data *data, uint32_t *temperature)
+{
+    struct aht20_sample sample;
+    int ret;
 
-    // Tính toán nhiệt độ và độ ẩm
-    hum = (buf[1] << 12) | (buf[2] << 4) | (buf[3] >> 4);// tong 20bit
-    // buf[1] lay 8 bit, dich trai 12 lan de vao 8 bit dau cua hum
-    // buf[2] lay 8 bit, dich trai 4 lan de vao 8 bit tiep theo
-    // buf[3] lay 4 bit dau cua byte[3], dich phai la de lay 4 bit dau tao ra ma 0000xxxx
+    ret = aht20_read_cached(data, 0, &sample, NULL);
+    if (ret < 0)
+        return ret;
 
-    *humidity = ((hum * 1000) / 1048576 ); // 1048576 0x100000
-    //Cong thuc: RH = ((S_RH/2^20)*100%)*10
-    hum = *humidity;
-    printk(KERN_INFO "AHT20 Read - Humidity: %d.%d%%\n", hum / 10, hum % 10);
+    *temperature = sample.temperature;
     return 0;
 }
 
-//Ham start
-static int aht20_start(struct i2c_client *client)
+// Ham read humidity
+static int aht20_read_humidity(struct aht20_data *data, uint32_t *humidity)
 {
-    u8 cmd[3];
+    struct aht20_sample sample;
     int ret;
 
-    // Gửi lệnh khởi tạo
-    cmd[0] = AHT20_CMD_INIT;
-    cmd[1] = 0x08;
-    cmd[2] = 0x00;
-    ret = i2c_master_send(client, cmd, 3);
+    ret = aht20_read_cached(data, 0, &sample, NULL);
+    if (ret < 0)
+        return ret;
+
+    *humidity = sample.humidity;
+    return 0;
+}
+
+//Ham start
+static int aht20_start(struct aht20_data *data)
+{
+    int ret = 0;
+
+    // Chi bat tay khi chua biet calibrated; 0xBE chi gui khi status bao can
+    mutex_lock(&data->lock);
+    if (!data->calibrated)
+        ret = aht20_handshake(data);
+    mutex_unlock(&data->lock);
     if (ret < 0) {
         printk(KERN_ERR "Failed to start sensor\n");
         return ret;
     }
 
-    msleep(10);
-
     printk(KERN_INFO "AHT20 sensor started\n");
     return 0;
 }
 
 //Ham Stop
-static int aht20_stop(struct i2c_client *client)
+static int aht20_stop(struct aht20_data *data)
 {
     u8 cmd [3];
     int ret;
@@ -268,31 +728,255 @@ static int aht20_stop(struct i2c_client *client)
     cmd[0] = AHT20_CMD_MEASURE_STOP;  // lệnh giả định, nếu không có lệnh dừng cụ thể
     cmd[1] = 0x00;
     cmd[2] = 0x00;
-    ret = i2c_master_send(client, cmd, 3);
+    mutex_lock(&data->lock);
+    ret = i2c_master_send(data->client, cmd, 3);
     if (ret < 0) {
+        mutex_unlock(&data->lock);
         printk(KERN_ERR "Failed to stop sensor\n");
         return ret;
     }
 
     msleep(10);
+    mutex_unlock(&data->lock);
 
     printk(KERN_INFO "AHT20 sensor stopped\n");
     return 0;
 }
 
+static bool aht20_queue_event(struct aht20_data *data, const struct aht20_sample *sample,
+                              unsigned int channel, unsigned int type, s32 value)
+{
+    struct aht20_event ev = {
+        .timestamp_ns   = sample->timestamp_ns,
+        .seq            = sample->seq,
+        .channel        = channel,
+        .type           = type,
+        .value          = value,
+    };
+
+    if (!kfifo_put(&data->events, ev)) {
+        aht20_stat_inc(&data->stats.event_drops);
+        return false;
+    }
+    aht20_stat_inc(&data->stats.events);
+    return true;
+}
+
+// So mot kenh voi nguong cua no; tra ve true neu co su kien moi
+static bool aht20_check_channel(struct aht20_data *data, const struct aht20_sample *sample,
+                                unsigned int channel, s32 value)
+{
+    struct aht20_thresh *th = &data->thresh[channel];
+    s32 hyst = th->cfg.hysteresis;
+    bool queued = false;
+
+    if (th->cfg.enable & AHT20_THRESH_HIGH) {
+        if (!th->high_active && value > th->cfg.high) {
+            th->high_active = true;
+            queued |= aht20_queue_event(data, sample, channel, AHT20_EV_HIGH, value);
+        } else if (th->high_active && value < th->cfg.high - hyst) {
+            th->high_active = false;
+            queued |= aht20_queue_event(data, sample, channel, AHT20_EV_HIGH_CLEAR, value);
+        }
+    }
+
+    if (th->cfg.enable & AHT20_THRESH_LOW) {
+        if (!th->low_active && value < th->cfg.low) {
+            th->low_active = true;
+            queued |= aht20_queue_event(data, sample, channel, AHT20_EV_LOW, value);
+        } else if (th->low_active && value > th->cfg.low + hyst) {
+            th->low_active = false;
+            queued |= aht20_queue_event(data, sample, channel, AHT20_EV_LOW_CLEAR, value);
+        }
+    }
+    return queued;
+}
+
+// Ham kiem tra nguong cho mau cua sampler; chi danh thuc khi co su kien
+static void aht20_check_thresholds(struct aht20_data *data, const struct aht20_sample *sample)
+{
+    bool queued;
+
+    spin_lock(&data->event_lock);
+    queued = aht20_check_channel(data, sample, AHT20_CHAN_TEMPERATURE, sample->temperature);
+    queued |= aht20_check_channel(data, sample, AHT20_CHAN_HUMIDITY, sample->humidity);
+    spin_unlock(&data->event_lock);
+
+    if (queued) {
+        wake_up_interruptible(&data->chrdev->wq);
+        kill_fasync(&data->chrdev->fasync, SIGIO, POLL_PRI);
+    }
+}
+
+// Khoang do cua moi kenh theo don vi 0.1: -50..150 do C, 0..100 %RH
+static const u32 aht20_chan_span[AHT20_CHAN_COUNT] = {
+    [AHT20_CHAN_TEMPERATURE] = 2000,
+    [AHT20_CHAN_HUMIDITY] = 1000,
+};
+
+static int aht20_set_threshold(struct aht20_data *data, const struct aht20_threshold *th)
+{
+    s32 edge;
+
+    if (th->channel >= AHT20_CHAN_COUNT)
+        return -EINVAL;
+    // aht20_check_channel tinh high - hyst va low + hyst bang s32: khong duoc tran
+    if (th->hysteresis > aht20_chan_span[th->channel])
+        return -EINVAL;
+    if ((th->enable & AHT20_THRESH_HIGH) &&
+        check_sub_overflow(th->high, (s32)th->hysteresis, &edge))
+        return -EINVAL;
+    if ((th->enable & AHT20_THRESH_LOW) &&
+        check_add_overflow(th->low, (s32)th->hysteresis, &edge))
+        return -EINVAL;
+    if (th->enable & ~(AHT20_THRESH_HIGH | AHT20_THRESH_LOW))
+        return -EINVAL;
+    if ((th->enable & AHT20_THRESH_HIGH) && (th->enable & AHT20_THRESH_LOW) &&
+        th->low >= th->high)
+        return -EINVAL;
+
+    // Trang thai bat dau lai: mau ke tiep da vuot nguong se bao ngay
+    spin_lock(&data->event_lock);
+    data->thresh[th->channel].cfg = *th;
+    data->thresh[th->channel].high_active = false;
+    data->thresh[th->channel].low_active = false;
+    spin_unlock(&data->event_lock);
+    return 0;
+}
+
+static int aht20_get_threshold(struct aht20_data *data, struct aht20_threshold *th)
+{
+    if (th->channel >= AHT20_CHAN_COUNT)
+        return -EINVAL;
+
+    spin_lock(&data->event_lock);
+    *th = data->thresh[th->channel].cfg;
+    spin_unlock(&data->event_lock);
+    return 0;
+}
+
+// Sampler: mot lan do moi period_ms, ket qua vao fifo
+static void aht20_sample_work(struct work_struct *work)
+{
+    struct aht20_data *data = container_of(to_delayed_work(work), struct aht20_data, work);
+    struct aht20_sample sample;
+    unsigned int period = READ_ONCE(data->period_ms);
+    long delay;
+
+    if (aht20_read_sample(data, &sample) == 0) {
+        // Mot writer (work nay), mot reader (read_lock): kfifo khong can khoa them
+        if (!kfifo_put(&data->fifo, sample))
+            data->overruns++;
+        if (kfifo_len(&data->fifo) >= READ_ONCE(data->watermark))
+            wake_up_interruptible(&data->chrdev->wq);
+        aht20_check_thresholds(data, &sample);
+    }
+
+    if (!period)
+        return;
+
+    // Tinh tu moc truoc de chu ky khong troi theo thoi gian do
+    data->next_jiffies += msecs_to_jiffies(period);
+    delay = (long)(data->next_jiffies - jiffies);
+    if (delay < 0) {
+        data->next_jiffies = jiffies;
+        delay = 0;
+    }
+    schedule_delayed_work(&data->work, delay);
+}
+
+static int aht20_set_period(struct aht20_data *data, unsigned int period_ms)
+{
+    if (period_ms && period_ms < AHT20_MIN_PERIOD_MS)
+        return -EINVAL;
+
+    mutex_lock(&data->cfg_lock);
+    if (data->shutdown) {
+        mutex_unlock(&data->cfg_lock);
+        return -ENODEV;
+    }
+    WRITE_ONCE(data->period_ms, period_ms);
+    cancel_delayed_work_sync(&data->work);
+    if (period_ms) {
+        data->next_jiffies = jiffies;
+        schedule_delayed_work(&data->work, 0);
+    }
+    mutex_unlock(&data->cfg_lock);
+
+    // Danh thuc reader dang cho khi sampler dung
+    wake_up_interruptible(&data->chrdev->wq);
+    return 0;
+}
+
+static int aht20_set_watermark(struct aht20_data *data, unsigned int watermark)
+{
+    if (watermark < 1 || watermark > AHT20_FIFO_SIZE)
+        return -EINVAL;
+
+    WRITE_ONCE(data->watermark, watermark);
+    wake_up_interruptible(&data->chrdev->wq);
+    return 0;
+}
+
+// Lay data cua fd va giu rwsem doc toi aht20_chrdev_exit; NULL khi cam bien da bi go
+static struct aht20_data *aht20_chrdev_enter(struct aht20_chrdev *cd)
+{
+    down_read(&cd->rwsem);
+    if (cd->dead) {
+        up_read(&cd->rwsem);
+        return NULL;
+    }
+    return cd->data;
+}
+
+static void aht20_chrdev_exit(struct aht20_chrdev *cd)
+{
+    up_read(&cd->rwsem);
+}
+
+static void aht20_chrdev_free(struct kref *ref)
+{
+    kfree(container_of(ref, struct aht20_chrdev, ref));
+}
+
+static void aht20_chrdev_put(void *cd)
+{
+    kref_put(&((struct aht20_chrdev *)cd)->ref, aht20_chrdev_free);
+}
+
+// Goi o remove: danh thuc reader/poll/SIGIO, roi cho cac fop dang chay ra het.
+// dead dat truoc down_write vi read() giu rwsem doc trong luc cho tren wq.
+static void aht20_chrdev_kill(struct aht20_chrdev *cd)
+{
+    WRITE_ONCE(cd->dead, true);
+    wake_up_interruptible_all(&cd->wq);
+    kill_fasync(&cd->fasync, SIGIO, POLL_HUP);
+
+    down_write(&cd->rwsem);
+    cd->data = NULL;
+    up_write(&cd->rwsem);
+}
+
 //Ham ioctl
-static long aht20_ioctl(struct file *filep, unsigned int cmd, unsigned long arg) 
+static long aht20_do_ioctl(struct aht20_data *data, unsigned int cmd, unsigned long arg)
 {
     int ret;
-    int temperature;
-    int humidity;
+    uint32_t temperature;
+    uint32_t humidity;
+    uint32_t value;
+    struct aht20_sample sample;
+    struct aht20_timings timings;
+    struct aht20_cached_read cached;
+    struct aht20_filter filter;
+    struct aht20_threshold threshold;
+    struct aht20_event event;
 
     switch (cmd) {
         case AHT20_READ_TEMPERATURE:
             // Gọi hàm aht20_read_data để đọc dữ liệu nhiệt độ từ cảm biến AHT20
-            ret = aht20_read_temperature(aht20_client, &temperature);
+            ret = aht20_read_temperature(data, &temperature);
             if (ret < 0) {
-                printk(KERN_ERR "Failed to read temperature data from AHT20\n");
+                printk_ratelimited(KERN_ERR "Failed to read temperature data from AHT20\n");
                 return ret;
             }
             // Sao chép dữ liệu nhiệt độ đến không gian người dùng
@@ -302,9 +986,9 @@ static long aht20_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
             break;
         case AHT20_READ_HUMIDITY:
             // Gọi hàm aht20_read_data để đọc dữ liệu độ ẩm từ cảm biến AHT20
-            ret = aht20_read_humidity(aht20_client, &humidity);
+            ret = aht20_read_humidity(data, &humidity);
             if (ret < 0) {
-                printk(KERN_ERR "Failed to read humidity data from AHT20\n");
+                printk_ratelimited(KERN_ERR "Failed to read humidity data from AHT20\n");
                 return ret;
             }
             // Sao chép dữ liệu độ ẩm đến không gian người dùng
@@ -312,15 +996,88 @@ static long aht20_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
                 return -EFAULT;
             }
             break;
+        case AHT20_READ_SAMPLE:
+            ret = aht20_read_cached(data, 0, &sample, NULL);
+            if (ret < 0) {
+                printk_ratelimited(KERN_ERR "Failed to read sample from AHT20\n");
+                return ret;
+            }
+            if (copy_to_user((void __user *)arg, &sample, sizeof(sample))) {
+                return -EFAULT;
+            }
+            break;
+        case AHT20_READ_CACHED:
+            if (copy_from_user(&cached, (void __user *)arg, sizeof(cached))) {
+                return -EFAULT;
+            }
+            ret = aht20_read_cached(data, cached.max_age_ms, &cached.sample, &cached.flags);
+            if (ret < 0) {
+                printk_ratelimited(KERN_ERR "Failed to read sample from AHT20\n");
+                return ret;
+            }
+            if (copy_to_user((void __user *)arg, &cached, sizeof(cached))) {
+                return -EFAULT;
+            }
+            break;
+        case AHT20_SET_FILTER:
+            if (copy_from_user(&filter, (void __user *)arg, sizeof(filter)))
+                return -EFAULT;
+            return aht20_set_filter(data, &filter);
+        case AHT20_GET_FILTER:
+            aht20_get_filter(data, &filter);
+            if (copy_to_user((void __user *)arg, &filter, sizeof(filter))) {
+                return -EFAULT;
+            }
+            break;
+        case AHT20_SET_THRESHOLD:
+            if (copy_from_user(&threshold, (void __user *)arg, sizeof(threshold)))
+                return -EFAULT;
+            return aht20_set_threshold(data, &threshold);
+        case AHT20_GET_THRESHOLD:
+            if (copy_from_user(&threshold, (void __user *)arg, sizeof(threshold)))
+                return -EFAULT;
+            ret = aht20_get_threshold(data, &threshold);
+            if (ret < 0)
+                return ret;
+            if (copy_to_user((void __user *)arg, &threshold, sizeof(threshold))) {
+                return -EFAULT;
+            }
+            break;
+        case AHT20_READ_EVENT:
+            spin_lock(&data->event_lock);
+            ret = kfifo_get(&data->events, &event);
+            spin_unlock(&data->event_lock);
+            if (!ret)
+                return -EAGAIN;
+            if (copy_to_user((void __user *)arg, &event, sizeof(event))) {
+                return -EFAULT;
+            }
+            break;
+        case AHT20_GET_TIMINGS:
+            mutex_lock(&data->lock);
+            timings = data->last_timings;
+            mutex_unlock(&data->lock);
+            if (copy_to_user((void __user *)arg, &timings, sizeof(timings))) {
+                return -EFAULT;
+            }
+            break;
+        case AHT20_SET_PERIOD:
+            if (copy_from_user(&value, (void __user *)arg, sizeof(value)))
+                return -EFAULT;
+            return aht20_set_period(data, value);
+        case AHT20_SET_WATERMARK:
+            if (copy_from_user(&value, (void __user *)arg, sizeof(value)))
+                return -EFAULT;
+            return aht20_set_watermark(data, value);
         case AHT20_START:
-            ret = aht20_start(aht20_client);
+            ret = aht20_start(data);
             if (ret < 0) {
                 printk(KERN_ERR "Failed to start AHT20\n");
                 return ret;
             }
             break;
         case AHT20_STOP:
-            ret = aht20_stop(aht20_client);
+            ret = aht20_stop(data);
             if (ret < 0) {
                 printk(KERN_ERR "Failed to stop AHT20\n");
                 return ret;
@@ -333,69 +1090,692 @@ static long aht20_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
     return 0;
 }
 
+static long aht20_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
+{
+    struct aht20_chrdev *cd = filep->private_data;
+    struct aht20_data *data;
+    long ret;
+
+    data = aht20_chrdev_enter(cd);
+    if (!data)
+        return -ENODEV;
+    ret = aht20_do_ioctl(data, cmd, arg);
+    aht20_chrdev_exit(cd);
+    return ret;
+}
+
+// Ham read: lay cac mau nguyen ven tu fifo cua sampler
+static ssize_t aht20_read(struct file *filep, char __user *buf, size_t len, loff_t *off)
+{
+    struct aht20_chrdev *cd = filep->private_data;
+    struct aht20_data *data;
+    struct aht20_sample sample;
+    size_t copied = 0;
+    ssize_t ret;
+
+    if (len < sizeof(sample))
+        return -EINVAL;
+
+    data = aht20_chrdev_enter(cd);
+    if (!data)
+        return -ENODEV;
+
+    if (!(filep->f_flags & O_NONBLOCK)) {
+        // Cho toi watermark, hoac tra ve phan con lai khi sampler da tat.
+        // remove dat dead truoc khi lay rwsem ghi, nen cung phai thoat khi do.
+        ret = wait_event_interruptible(cd->wq,
+                READ_ONCE(cd->dead) ||
+                kfifo_len(&data->fifo) >= READ_ONCE(data->watermark) ||
+                !READ_ONCE(data->period_ms));
+        if (!ret && READ_ONCE(cd->dead))
+            ret = -ENODEV;
+        if (ret)
+            goto out;
+    }
+
+    if (mutex_lock_interruptible(&data->read_lock)) {
+        ret = -ERESTARTSYS;
+        goto out;
+    }
+
+    while (copied + sizeof(sample) <= len && kfifo_peek(&data->fifo, &sample)) {
+        if (copy_to_user(buf + copied, &sample, sizeof(sample))) {
+            mutex_unlock(&data->read_lock);
+            ret = copied ? copied : -EFAULT;
+            goto out;
+        }
+        kfifo_skip(&data->fifo);
+        copied += sizeof(sample);
+    }
+    mutex_unlock(&data->read_lock);
+
+    if (!copied && (filep->f_flags & O_NONBLOCK))
+        ret = -EAGAIN;
+    else
+        ret = copied;
+out:
+    aht20_chrdev_exit(cd);
+    return ret;
+}
+
+// Ham poll: san sang doc khi fifo dat watermark
+static __poll_t aht20_poll(struct file *filep, poll_table *wait)
+{
+    struct aht20_chrdev *cd = filep->private_data;
+    struct aht20_data *data;
+    __poll_t mask = 0;
+
+    poll_wait(filep, &cd->wq, wait);
+    data = aht20_chrdev_enter(cd);
+    if (!data)
+        return EPOLLERR | EPOLLHUP;
+    if (kfifo_len(&data->fifo) >= READ_ONCE(data->watermark))
+        mask |= EPOLLIN | EPOLLRDNORM;
+    if (!kfifo_is_empty(&data->events))
+        mask |= EPOLLPRI;
+    aht20_chrdev_exit(cd);
+
+    return mask;
+}
+
+
+// Ham mmap: mot trang chi doc, xem struct aht20_shared
+static int aht20_mmap(struct file *filep, struct vm_area_struct *vma)
+{
+    struct aht20_chrdev *cd = filep->private_data;
+    struct aht20_data *data;
+    int ret;
+
+    if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start != PAGE_SIZE)
+        return -EINVAL;
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+
+    data = aht20_chrdev_enter(cd);
+    if (!data)
+        return -ENODEV;
+    vma->vm_flags &= ~VM_MAYWRITE;
+    vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+    ret = vm_insert_page(vma, vma->vm_start, virt_to_page(data->shared));
+    aht20_chrdev_exit(cd);
+    return ret;
+}
 
 
 //Ham open
 static int aht20_open(struct inode *inodep, struct file *filep)
 {
-    printk(KERN_INFO "AHT20 device opened\n");
+    struct aht20_chrdev *cd;
+
+    // Tim theo minor duoi khoa de khong lay trung chrdev dang bi remove giai phong
+    mutex_lock(&aht20_minors_lock);
+    cd = idr_find(&aht20_minors, iminor(inodep));
+    if (cd)
+        kref_get(&cd->ref);
+    mutex_unlock(&aht20_minors_lock);
+    if (!cd)
+        return -ENODEV;
+
+    filep->private_data = cd;
+    trace_aht20_open(cd->minor);
     return 0;
 }
+// SIGIO khi co su kien nguong (fcntl F_SETOWN + O_ASYNC)
+static int aht20_fasync(int fd, struct file *filep, int on)
+{
+    struct aht20_chrdev *cd = filep->private_data;
+
+    return fasync_helper(fd, filep, on, &cd->fasync);
+}
+
 // Ham file_operations
 static struct file_operations fops = {
     .open = aht20_open,
+    .read = aht20_read,
+    .poll = aht20_poll,
+    .fasync = aht20_fasync,
+    .mmap = aht20_mmap,
     .unlocked_ioctl = aht20_ioctl,
     .release = aht20_release,
-    
+
 };
 
 // Ham release
 static int aht20_release(struct inode *inodep, struct file *filep)
 {
-    printk(KERN_INFO "AHT20 device closed\n");
+    struct aht20_chrdev *cd = filep->private_data;
+
+    aht20_fasync(-1, filep, 0);
+    trace_aht20_release(cd->minor);
+    aht20_chrdev_put(cd);
+    return 0;
+}
+
+
+// sysfs: /sys/class/aht20_class/aht20_devN/{period_ms,watermark,overruns,
+// oversample,filter,iir_shift}
+static ssize_t period_ms_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct aht20_data *data = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%u\n", READ_ONCE(data->period_ms));
+}
+
+static ssize_t period_ms_store(struct device *dev, struct device_attribute *attr,
+                               const char *buf, size_t count)
+{
+    struct aht20_data *data = dev_get_drvdata(dev);
+    unsigned int val;
+    int ret;
+
+    ret = kstrtouint(buf, 0, &val);
+    if (ret)
+        return ret;
+    ret = aht20_set_period(data, val);
+    return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(period_ms);
+
+static ssize_t watermark_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct aht20_data *data = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%u\n", READ_ONCE(data->watermark));
+}
+
+static ssize_t watermark_store(struct device *dev, struct device_attribute *attr,
+                               const char *buf, size_t count)
+{
+    struct aht20_data *data = dev_get_drvdata(dev);
+    unsigned int val;
+    int ret;
+
+    ret = kstrtouint(buf, 0, &val);
+    if (ret)
+        return ret;
+    ret = aht20_set_watermark(data, val);
+    return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(watermark);
+
+static ssize_t oversample_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct aht20_data *data = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%u\n", READ_ONCE(data->oversample));
+}
+
+static ssize_t oversample_store(struct device *dev, struct device_attribute *attr,
+                                const char *buf, size_t count)
+{
+    struct aht20_data *data = dev_get_drvdata(dev);
+    struct aht20_filter f;
+    int ret;
+
+    aht20_get_filter(data, &f);
+    ret = kstrtouint(buf, 0, &f.oversample);
+    if (ret)
+        return ret;
+    ret = aht20_set_filter(data, &f);
+    return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(oversample);
+
+static const char * const aht20_filter_names[] = {
+    [AHT20_FILTER_MEAN]     = "mean",
+    [AHT20_FILTER_MEDIAN]   = "median",
+    [AHT20_FILTER_IIR]      = "iir",
+};
+
+static ssize_t filter_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct aht20_data *data = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%s\n", aht20_filter_names[READ_ONCE(data->filter)]);
+}
+
+static ssize_t filter_store(struct device *dev, struct device_attribute *attr,
+                            const char *buf, size_t count)
+{
+    struct aht20_data *data = dev_get_drvdata(dev);
+    struct aht20_filter f;
+    int ret;
+
+    ret = sysfs_match_string(aht20_filter_names, buf);
+    if (ret < 0)
+        return ret;
+    aht20_get_filter(data, &f);
+    f.mode = ret;
+    ret = aht20_set_filter(data, &f);
+    return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(filter);
+
+static ssize_t iir_shift_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct aht20_data *data = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%u\n", READ_ONCE(data->iir_shift));
+}
+
+static ssize_t iir_shift_store(struct device *dev, struct device_attribute *attr,
+                               const char *buf, size_t count)
+{
+    struct aht20_data *data = dev_get_drvdata(dev);
+    unsigned int val;
+    int ret;
+
+    ret = kstrtouint(buf, 0, &val);
+    if (ret)
+        return ret;
+    if (val < 1 || val > AHT20_IIR_MAX_SHIFT)
+        return -EINVAL;
+
+    mutex_lock(&data->lock);
+    data->iir_shift = val;
+    data->iir_valid = false;
+    mutex_unlock(&data->lock);
+    return count;
+}
+static DEVICE_ATTR_RW(iir_shift);
+
+static ssize_t overruns_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct aht20_data *data = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%u\n", READ_ONCE(data->overruns));
+}
+static DEVICE_ATTR_RO(overruns);
+
+static ssize_t recovery_ms_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct aht20_data *data = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%u\n", READ_ONCE(data->recovery_ms));
+}
+
+static ssize_t recovery_ms_store(struct device *dev, struct device_attribute *attr,
+                                 const char *buf, size_t count)
+{
+    struct aht20_data *data = dev_get_drvdata(dev);
+    unsigned int val;
+    int ret;
+
+    ret = kstrtouint(buf, 0, &val);
+    if (ret)
+        return ret;
+    if (val > AHT20_RECOVERY_MAX_MS)
+        return -EINVAL;
+    WRITE_ONCE(data->recovery_ms, val);
+    return count;
+}
+static DEVICE_ATTR_RW(recovery_ms);
+
+static struct attribute *aht20_attrs[] = {
+    &dev_attr_period_ms.attr,
+    &dev_attr_watermark.attr,
+    &dev_attr_overruns.attr,
+    &dev_attr_oversample.attr,
+    &dev_attr_filter.attr,
+    &dev_attr_iir_shift.attr,
+    &dev_attr_recovery_ms.attr,
+    NULL,
+};
+
+static const struct attribute_group aht20_group = {
+    .attrs = aht20_attrs,
+};
+
+// Thu muc stats/: moi bo dem mot file
+#define AHT20_STAT_ATTR(_name)                                                   \
+static ssize_t _name##_show(struct device *dev, struct device_attribute *attr,  \
+                            char *buf)                                          \
+{                                                                               \
+    struct aht20_data *data = dev_get_drvdata(dev);                             \
+                                                                                \
+    return sysfs_emit(buf, "%lu\n", READ_ONCE(data->stats._name));              \
+}                                                                               \
+static DEVICE_ATTR_RO(_name)
+
+AHT20_STAT_ATTR(reads);
+AHT20_STAT_ATTR(crc_errors);
+AHT20_STAT_ATTR(busy_retries);
+AHT20_STAT_ATTR(i2c_errors);
+AHT20_STAT_ATTR(reinits);
+AHT20_STAT_ATTR(status_skips);
+AHT20_STAT_ATTR(cache_hits);
+AHT20_STAT_ATTR(coalesced);
+AHT20_STAT_ATTR(events);
+AHT20_STAT_ATTR(event_drops);
+AHT20_STAT_ATTR(retriggers);
+AHT20_STAT_ATTR(soft_resets);
+AHT20_STAT_ATTR(bus_recoveries);
+AHT20_STAT_ATTR(recovered);
+AHT20_STAT_ATTR(recovery_failures);
+
+static struct attribute *aht20_stats_attrs[] = {
+    &dev_attr_reads.attr,
+    &dev_attr_crc_errors.attr,
+    &dev_attr_busy_retries.attr,
+    &dev_attr_i2c_errors.attr,
+    &dev_attr_reinits.attr,
+    &dev_attr_status_skips.attr,
+    &dev_attr_cache_hits.attr,
+    &dev_attr_coalesced.attr,
+    &dev_attr_events.attr,
+    &dev_attr_event_drops.attr,
+    &dev_attr_retriggers.attr,
+    &dev_attr_soft_resets.attr,
+    &dev_attr_bus_recoveries.attr,
+    &dev_attr_recovered.attr,
+    &dev_attr_recovery_failures.attr,
+    NULL,
+};
+
+static const struct attribute_group aht20_stats_group = {
+    .name = "stats",
+    .attrs = aht20_stats_attrs,
+};
+
+static const struct attribute_group *aht20_groups[] = {
+    &aht20_group,
+    &aht20_stats_group,
+    NULL,
+};
+
+
+// debugfs: histogram log2 do tre cua tung pha
+static const char * const aht20_phase_names[AHT20_PH_COUNT] = {
+    [AHT20_PH_STATUS]   = "status",
+    [AHT20_PH_TRIGGER]  = "trigger",
+    [AHT20_PH_WAIT]     = "wait",
+    [AHT20_PH_FETCH]    = "fetch",
+};
+
+static int aht20_latency_show(struct seq_file *m, void *v)
+{
+    struct aht20_data *data = m->private;
+    int phase, bucket;
+
+    seq_puts(m, "us_below");
+    for (phase = 0; phase < AHT20_PH_COUNT; phase++)
+        seq_printf(m, " %s", aht20_phase_names[phase]);
+    seq_putc(m, '\n');
+
+    for (bucket = 0; bucket < AHT20_HIST_BUCKETS; bucket++) {
+        if (bucket == AHT20_HIST_BUCKETS - 1)
+            seq_puts(m, "inf");
+        else
+            seq_printf(m, "%lu", 1UL << bucket);
+        for (phase = 0; phase < AHT20_PH_COUNT; phase++)
+            seq_printf(m, " %u", READ_ONCE(data->stats.hist[phase][bucket]));
+        seq_putc(m, '\n');
+    }
     return 0;
 }
+DEFINE_SHOW_ATTRIBUTE(aht20_latency);
+
 
+// IIO: in_temp_raw/in_humidityrelative_raw + scale/offset, buffer qua trigger
+// T (m do C) = (raw + offset) * scale, voi scale = 200000 / 2^20, offset = -2^18
+// RH (m %)   = raw * scale,            voi scale = 100000 / 2^20
+enum {
+    AHT20_SCAN_TEMP,
+    AHT20_SCAN_HUMIDITY,
+    AHT20_SCAN_TIMESTAMP,
+};
+
+static const struct iio_chan_spec aht20_channels[] = {
+    {
+        .type = IIO_TEMP,
+        .info_mask_separate = BIT(IIO_CHAN_INFO_RAW) |
+                              BIT(IIO_CHAN_INFO_SCALE) |
+                              BIT(IIO_CHAN_INFO_OFFSET),
+        .scan_index = AHT20_SCAN_TEMP,
+        .scan_type = {
+            .sign = 'u',
+            .realbits = 20,
+            .storagebits = 32,
+            .endianness = IIO_CPU,
+        },
+    },
+    {
+        .type = IIO_HUMIDITYRELATIVE,
+        .info_mask_separate = BIT(IIO_CHAN_INFO_RAW) |
+                              BIT(IIO_CHAN_INFO_SCALE),
+        .scan_index = AHT20_SCAN_HUMIDITY,
+        .scan_type = {
+            .sign = 'u',
+            .realbits = 20,
+            .storagebits = 32,
+            .endianness = IIO_CPU,
+        },
+    },
+    IIO_CHAN_SOFT_TIMESTAMP(AHT20_SCAN_TIMESTAMP),
+};
+
+// Ca hai kenh luon den tu cung mot frame
+static const unsigned long aht20_scan_masks[] = {
+    BIT(AHT20_SCAN_TEMP) | BIT(AHT20_SCAN_HUMIDITY),
+    0,
+};
+
+static int aht20_iio_read_raw(struct iio_dev *indio_dev, struct iio_chan_spec const *chan,
+                              int *val, int *val2, long mask)
+{
+    struct aht20_data *data = iio_priv(indio_dev);
+    struct aht20_sample sample;
+    int ret;
+
+    switch (mask) {
+    case IIO_CHAN_INFO_RAW:
+        ret = iio_device_claim_direct_mode(indio_dev);
+        if (ret)
+            return ret;
+        ret = aht20_read_cached(data, 0, &sample, NULL);
+        iio_device_release_direct_mode(indio_dev);
+        if (ret < 0)
+            return ret;
+        *val = chan->type == IIO_TEMP ? sample.raw_temperature : sample.raw_humidity;
+        return IIO_VAL_INT;
+    case IIO_CHAN_INFO_SCALE:
+        *val = chan->type == IIO_TEMP ? 200000 : 100000;
+        *val2 = 20;
+        return IIO_VAL_FRACTIONAL_LOG2;
+    case IIO_CHAN_INFO_OFFSET:
+        if (chan->type != IIO_TEMP)
+            return -EINVAL;
+        *val = -(1 << 18);  // -50 do C = -50 * 2^20 / 200
+        return IIO_VAL_INT;
+    default:
+        return -EINVAL;
+    }
+}
+
+static const struct iio_info aht20_iio_info = {
+    .read_raw = aht20_iio_read_raw,
+};
+
+// Trigger handler: mot lan do, day ca hai kenh + timestamp luc doc frame
+static irqreturn_t aht20_trigger_handler(int irq, void *p)
+{
+    struct iio_poll_func *pf = p;
+    struct iio_dev *indio_dev = pf->indio_dev;
+    struct aht20_data *data = iio_priv(indio_dev);
+    struct aht20_sample sample;
+    struct {
+        u32 chans[2];
+        s64 timestamp __aligned(8);
+    } scan;
+
+    if (aht20_read_sample(data, &sample) == 0) {
+        memset(&scan, 0, sizeof(scan));
+        scan.chans[0] = sample.raw_temperature;
+        scan.chans[1] = sample.raw_humidity;
+        iio_push_to_buffers_with_timestamp(indio_dev, &scan, iio_get_time_ns(indio_dev));
+    }
+
+    iio_trigger_notify_done(indio_dev->trig);
+    return IRQ_HANDLED;
+}
+
+
+static void aht20_free_page(void *page)
+{
+    free_page((unsigned long)page);
+}
 
 // Ham probe
 static int aht20_probe(struct i2c_client *client, const struct i2c_device_id *id)
 {
-    aht20_client = client;
+    struct iio_dev *indio_dev;
+    struct aht20_data *data;
+    int ret;
 
-    // Tạo một char device
-    major_number = register_chrdev(0, DEVICE_NAME, &fops);
-    if (major_number < 0) {
-        printk(KERN_ERR "Failed to register a major number\n");
-        return major_number;
+    // Mot trang thai cho ca chardev lan IIO
+    indio_dev = devm_iio_device_alloc(&client->dev, sizeof(*data));
+    if (!indio_dev)
+        return -ENOMEM;
+    data = iio_priv(indio_dev);
+
+    // chrdev khong phai devm: fd mo giu no sau remove. devm chi tra tham chieu cua probe.
+    data->chrdev = kzalloc(sizeof(*data->chrdev), GFP_KERNEL);
+    if (!data->chrdev)
+        return -ENOMEM;
+    kref_init(&data->chrdev->ref);
+    init_rwsem(&data->chrdev->rwsem);
+    init_waitqueue_head(&data->chrdev->wq);
+    data->chrdev->data = data;
+    ret = devm_add_action_or_reset(&client->dev, aht20_chrdev_put, data->chrdev);
+    if (ret)
+        return ret;
+
+    data->client = client;
+    mutex_init(&data->lock);
+    mutex_init(&data->cfg_lock);
+    mutex_init(&data->read_lock);
+    INIT_DELAYED_WORK(&data->work, aht20_sample_work);
+    INIT_KFIFO(data->fifo);
+    spin_lock_init(&data->event_lock);
+    INIT_KFIFO(data->events);
+    data->watermark = 1;
+    data->oversample = 1;
+    data->filter = AHT20_FILTER_MEAN;
+    data->iir_shift = AHT20_IIR_DEFAULT_SHIFT;
+    data->recovery_ms = AHT20_RECOVERY_DEFAULT_MS;
+    i2c_set_clientdata(client, data);
+
+    // Bat tay mot lan luc probe (probe bat dong bo nen cac cam bien chay song song).
+    // Loi khong lam hong probe: lan doc dau tien se thu lai.
+    mutex_lock(&data->lock);
+    ret = aht20_handshake(data);
+    mutex_unlock(&data->lock);
+    if (ret < 0)
+        printk(KERN_WARNING "AHT20 calibration check failed at probe: %d\n", ret);
+
+    // vm_insert_page giu them mot tham chieu, nen giai phong trang van an toan
+    // khi con process dang map no. devm: giai phong sau khi IIO da go.
+    data->shared = (struct aht20_shared *)get_zeroed_page(GFP_KERNEL);
+    if (!data->shared)
+        return -ENOMEM;
+    ret = devm_add_action_or_reset(&client->dev, aht20_free_page, data->shared);
+    if (ret)
+        return ret;
+
+    // Tạo một char device: minor rieng trong vung da dang ky o aht20_init
+    mutex_lock(&aht20_minors_lock);
+    data->minor = idr_alloc(&aht20_minors, data->chrdev, 0, AHT20_MAX_DEVICES, GFP_KERNEL);
+    mutex_unlock(&aht20_minors_lock);
+    if (data->minor < 0) {
+        printk(KERN_ERR "No free AHT20 minor number\n");
+        return data->minor;
     }
+    data->chrdev->minor = data->minor;
 
-    aht20_class = class_create(THIS_MODULE, CLASS_NAME);
-    if (IS_ERR(aht20_class)) {
-        unregister_chrdev(major_number, DEVICE_NAME);
-        printk(KERN_ERR "Failed to register device class\n");
-        return PTR_ERR(aht20_class);
+    data->chrdev->cdev = cdev_alloc();
+    if (!data->chrdev->cdev) {
+        ret = -ENOMEM;
+        goto err_minor;
+    }
+    data->chrdev->cdev->ops = &fops;
+    data->chrdev->cdev->owner = THIS_MODULE;
+    ret = cdev_add(data->chrdev->cdev, MKDEV(MAJOR(aht20_devt), data->minor), 1);
+    if (ret) {
+        printk(KERN_ERR "Failed to add the char device\n");
+        kobject_put(&data->chrdev->cdev->kobj);
+        goto err_minor;
     }
 
-    aht20_device = device_create(aht20_class, NULL, MKDEV(major_number, 0), NULL, DEVICE_NAME);
-    if (IS_ERR(aht20_device)) {
-        class_destroy(aht20_class);
-        unregister_chrdev(major_number, DEVICE_NAME);
+    data->dev = device_create_with_groups(aht20_class, &client->dev,
+                                          MKDEV(MAJOR(aht20_devt), data->minor),
+                                          data, aht20_groups, DEVICE_NAME "%d", data->minor);
+    if (IS_ERR(data->dev)) {
+        ret = PTR_ERR(data->dev);
         printk(KERN_ERR "Failed to create the device\n");
-        return PTR_ERR(aht20_device);
+        goto err_cdev;
+    }
+
+    indio_dev->name = "aht20";
+    indio_dev->info = &aht20_iio_info;
+    indio_dev->modes = INDIO_DIRECT_MODE;
+    indio_dev->channels = aht20_channels;
+    indio_dev->num_channels = ARRAY_SIZE(aht20_channels);
+    indio_dev->available_scan_masks = aht20_scan_masks;
+
+    ret = devm_iio_triggered_buffer_setup(&client->dev, indio_dev, NULL,
+                                          aht20_trigger_handler, NULL);
+    if (ret) {
+        printk(KERN_ERR "Failed to setup IIO triggered buffer\n");
+        goto err_chrdev;
     }
 
-    printk(KERN_INFO "AHT20 driver installed\n");
+    ret = devm_iio_device_register(&client->dev, indio_dev);
+    if (ret) {
+        printk(KERN_ERR "Failed to register IIO device\n");
+        goto err_chrdev;
+    }
+
+    data->debugfs = debugfs_create_dir(dev_name(data->dev), aht20_debugfs);
+    debugfs_create_file("latency", 0444, data->debugfs, data, &aht20_latency_fops);
+
+    printk(KERN_INFO "AHT20 driver installed as %s%d on %s\n",
+           DEVICE_NAME, data->minor, dev_name(&client->adapter->dev));
     return 0;
+
+err_chrdev:
+    device_destroy(aht20_class, MKDEV(MAJOR(aht20_devt), data->minor));
+err_cdev:
+    aht20_chrdev_kill(data->chrdev);
+    cdev_del(data->chrdev->cdev);
+err_minor:
+    mutex_lock(&aht20_minors_lock);
+    idr_remove(&aht20_minors, data->minor);
+    mutex_unlock(&aht20_minors_lock);
+    return ret;
 }
 
 
 // Ham remove
 static void aht20_remove(struct i2c_client *client)
 {
-    device_destroy(aht20_class, MKDEV(major_number, 0));
-    class_unregister(aht20_class);
-    class_destroy(aht20_class);
-    unregister_chrdev(major_number, DEVICE_NAME);
+    struct aht20_data *data = i2c_get_clientdata(client);
+
+    // Cung khoa voi aht20_set_period: sau day khong ai len lich work lai
+    mutex_lock(&data->cfg_lock);
+    data->shutdown = true;
+    WRITE_ONCE(data->period_ms, 0);
+    cancel_delayed_work_sync(&data->work);
+    mutex_unlock(&data->cfg_lock);
+
+    // fd con mo chi con thay -ENODEV; chrdev duoc giai phong khi fd cuoi dong
+    aht20_chrdev_kill(data->chrdev);
+
+    debugfs_remove_recursive(data->debugfs);
+    device_destroy(aht20_class, MKDEV(MAJOR(aht20_devt), data->minor));
+    cdev_del(data->chrdev->cdev);
+    mutex_lock(&aht20_minors_lock);
+    idr_remove(&aht20_minors, data->minor);
+    mutex_unlock(&aht20_minors_lock);
     printk(KERN_INFO "AHT20 driver removed\n");
 }
 
@@ -408,14 +1788,24 @@ static const struct of_device_id aht20_of_match[] = {
 
 MODULE_DEVICE_TABLE(of, aht20_of_match);
 
+// Ten de tao thiet bi bang tay hoac tu aht20_sim (new_device, i2c_new_client_device)
+static const struct i2c_device_id aht20_id[] = {
+    { "aht20", 0 },
+    { },
+};
+
+MODULE_DEVICE_TABLE(i2c, aht20_id);
+
 static struct i2c_driver aht20_driver = {
     .driver = {
         .name           = DEVICE_NAME,
         .owner          = THIS_MODULE,
         .of_match_table = of_match_ptr(aht20_of_match),
+        .probe_type     = PROBE_PREFER_ASYNCHRONOUS,
     },
     .probe      = aht20_probe,
     .remove     = aht20_remove,
+    .id_table   = aht20_id,
 };
 
 
@@ -423,8 +1813,33 @@ static struct i2c_driver aht20_driver = {
 // Ham init
 static int __init aht20_init(void)
 {
+    int ret;
+
     printk(KERN_INFO "Initializing AHT20 driver\n");
-    return i2c_add_driver(&aht20_driver);
+
+    // Mot vung chrdev va mot class cho moi cam bien
+    ret = alloc_chrdev_region(&aht20_devt, 0, AHT20_MAX_DEVICES, DEVICE_NAME);
+    if (ret < 0) {
+        printk(KERN_ERR "Failed to register a major number\n");
+        return ret;
+    }
+
+    aht20_class = class_create(THIS_MODULE, CLASS_NAME);
+    if (IS_ERR(aht20_class)) {
+        unregister_chrdev_region(aht20_devt, AHT20_MAX_DEVICES);
+        printk(KERN_ERR "Failed to register device class\n");
+        return PTR_ERR(aht20_class);
+    }
+
+    aht20_debugfs = debugfs_create_dir("aht20", NULL);
+
+    ret = i2c_add_driver(&aht20_driver);
+    if (ret) {
+        debugfs_remove_recursive(aht20_debugfs);
+        class_destroy(aht20_class);
+        unregister_chrdev_region(aht20_devt, AHT20_MAX_DEVICES);
+    }
+    return ret;
 }
 
 // Ham exit
@@ -432,6 +1847,10 @@ static void __exit aht20_exit(void)
 {
     printk(KERN_INFO "Exit AHT20 driver\n");
     i2c_del_driver(&aht20_driver);
+    debugfs_remove_recursive(aht20_debugfs);
+    class_destroy(aht20_class);
+    unregister_chrdev_region(aht20_devt, AHT20_MAX_DEVICES);
+    idr_destroy(&aht20_minors);
 }
 
 
@@ -440,4 +1859,4 @@ module_exit(aht20_exit);
 
 MODULE_AUTHOR("NamVanDuyCuong");
 MODULE_DESCRIPTION("AHT20 I2C Client Driver with IOCTL");
-MODULE_LICENSE("GPL");
\ No newline at end of file
+MODULE_LICENSE("GPL");
@@ -0,0 +1,159 @@
+#ifndef AHT20_IOCTL_H
+#define AHT20_IOCTL_H
+
+// Giao dien ioctl dung chung giua aht20_driver.c va chuong trinh user space
+
+#include <linux/types.h>
+#ifdef __KERNEL__
+#include <linux/ioctl.h>
+#else
+#include <sys/ioctl.h>
+#endif
+
+#define AHT20_IOCTL_MAGIC 'A'
+#define AHT20_IOCTL_MAGIC1 'B'
+
+#define AHT20_READ_TEMPERATURE _IOR(AHT20_IOCTL_MAGIC, 1, __u32)
+#define AHT20_READ_HUMIDITY _IOR(AHT20_IOCTL_MAGIC1, 0, __u32)
+#define AHT20_START _IO(AHT20_IOCTL_MAGIC, 2)
+#define AHT20_STOP _IO(AHT20_IOCTL_MAGIC, 3)
+
+// One conversion, both channels. Callers check .version before using
+// fields added after version 1.
+//   2: temperature_var, humidity_var, oversample, filter
+#define AHT20_SAMPLE_VERSION 2
+
+struct aht20_sample {
+    __u32 version;          // AHT20_SAMPLE_VERSION
+    __u32 seq;              // tang 1 sau moi lan do thanh cong
+    __s64 timestamp_ns;     // CLOCK_MONOTONIC luc doc frame
+    __s32 temperature;      // 0.1 do C
+    __u32 humidity;         // 0.1 %RH
+    __u32 raw_temperature;  // 20 bit S_T
+    __u32 raw_humidity;     // 20 bit S_RH
+    __u8  status;           // byte status cua frame
+    __u8  pad[3];
+    __u32 temperature_var;  // v2: phuong sai hieu dung, (0.001 do C)^2, 0 neu oversample 1
+    __u32 humidity_var;     // v2: (0.001 %RH)^2
+    __u8  oversample;       // v2: so lan chuyen doi gop thanh mau nay
+    __u8  filter;           // v2: AHT20_FILTER_*
+    __u8  pad2[2];
+    __u32 reserved[2];
+};
+
+#define AHT20_READ_SAMPLE _IOR(AHT20_IOCTL_MAGIC, 4, struct aht20_sample)
+
+// Thoi gian tung pha cua lan do gan nhat (micro giay)
+struct aht20_timings {
+    __u32 status_us;        // 0x71 + doc status, 0 neu da biet calibrated
+    __u32 init_us;          // 0xBE + cho, 0 neu khong can
+    __u32 trigger_us;       // gui 0xAC
+    __u32 wait_us;          // tu trigger den lan doc frame cuoi
+    __u32 fetch_us;         // doc frame 7 byte cuoi cung
+    __u32 total_us;
+    __u32 polls;            // so lan doc frame (>1 neu con busy)
+    __u32 reserved;
+};
+
+#define AHT20_GET_TIMINGS _IOR(AHT20_IOCTL_MAGIC, 5, struct aht20_timings)
+
+// Sampler dinh ky trong driver. Moi read() tra ve mot so nguyen
+// struct aht20_sample; poll() bao POLLIN khi fifo co >= watermark mau.
+// Cung chinh duoc qua sysfs: period_ms, watermark.
+#define AHT20_SET_PERIOD _IOW(AHT20_IOCTL_MAGIC, 6, __u32)      // ms, 0 = tat
+#define AHT20_SET_WATERMARK _IOW(AHT20_IOCTL_MAGIC, 7, __u32)   // 1..64 mau
+
+// mmap(fd, 4096, PROT_READ, MAP_SHARED, fd, 0): trang chi doc chua mau moi nhat.
+// Driver ghi theo kieu seqlock: lock_seq le khi dang ghi, tang 2 sau moi mau.
+// sample.version == 0 cho toi lan do dau tien.
+struct aht20_shared {
+    __u32 lock_seq;
+    __u32 pad;
+    struct aht20_sample sample;
+};
+
+// Doc co cache: tra mau moi nhat neu tuoi <= max_age_ms, neu khong thi do moi.
+// Nhieu caller cung luc dung chung mot lan chuyen doi dang chay.
+// AHT20_READ_TEMPERATURE/HUMIDITY/SAMPLE la truong hop max_age_ms = 0.
+#define AHT20_CACHED_HIT 0x1        // mau tu cache, du moi theo max_age_ms
+#define AHT20_CACHED_SHARED 0x2     // ket qua cua lan do dang chay luc goi
+
+struct aht20_cached_read {
+    __u32 max_age_ms;       // in
+    __u32 flags;            // out: AHT20_CACHED_*, 0 neu vua do moi
+    struct aht20_sample sample;
+};
+
+#define AHT20_READ_CACHED _IOWR(AHT20_IOCTL_MAGIC, 8, struct aht20_cached_read)
+
+// Oversampling: moi mau bao cao gop oversample lan chuyen doi (1, 2, 4, 8, 16).
+// raw_* la gia tri da loc; temperature/humidity tinh tu raw_* da loc.
+#define AHT20_FILTER_MEAN 0     // trung binh N lan
+#define AHT20_FILTER_MEDIAN 1   // trung vi N lan
+#define AHT20_FILTER_IIR 2      // trung binh N lan, roi y += (x - y) / 2^iir_shift giua cac mau
+
+struct aht20_filter {
+    __u32 oversample;
+    __u32 mode;             // AHT20_FILTER_*
+    __u32 iir_shift;        // 1..7, chi dung cho AHT20_FILTER_IIR
+    __u32 reserved;
+};
+
+#define AHT20_SET_FILTER _IOW(AHT20_IOCTL_MAGIC, 9, struct aht20_filter)
+#define AHT20_GET_FILTER _IOR(AHT20_IOCTL_MAGIC, 10, struct aht20_filter)
+
+// Nguong co tre, so voi cac mau cua sampler dinh ky (AHT20_SET_PERIOD).
+// Vuot len tren high: su kien AHT20_EV_HIGH, bao lai AHT20_EV_HIGH_CLEAR khi
+// xuong duoi high - hysteresis. Duoi low tuong tu voi low + hysteresis.
+// Co su kien: poll() bao EPOLLPRI, SIGIO neu da bat O_ASYNC (F_SETOWN),
+// AHT20_READ_EVENT lay tung su kien, -EAGAIN khi hang doi rong.
+#define AHT20_CHAN_TEMPERATURE 0
+#define AHT20_CHAN_HUMIDITY 1
+#define AHT20_CHAN_COUNT 2
+
+#define AHT20_THRESH_HIGH 0x1
+#define AHT20_THRESH_LOW 0x2
+
+struct aht20_threshold {
+    __u32 channel;          // AHT20_CHAN_*
+    __u32 enable;           // AHT20_THRESH_HIGH | AHT20_THRESH_LOW, 0 = tat
+    __s32 high;             // 0.1 do C hoac 0.1 %RH, nhu aht20_sample
+    __s32 low;
+    __u32 hysteresis;       // cung don vi, toi da khoang do cua kenh
+    __u32 reserved;
+};
+
+#define AHT20_EV_HIGH 1
+#define AHT20_EV_HIGH_CLEAR 2
+#define AHT20_EV_LOW 3
+#define AHT20_EV_LOW_CLEAR 4
+
+struct aht20_event {
+    __s64 timestamp_ns;     // timestamp_ns cua mau gay ra su kien
+    __u32 seq;              // seq cua mau do
+    __u16 channel;          // AHT20_CHAN_*
+    __u16 type;             // AHT20_EV_*
+    __s32 value;            // gia tri cua mau, 0.1 don vi
+    __u32 reserved;
+};
+
+#define AHT20_SET_THRESHOLD _IOW(AHT20_IOCTL_MAGIC, 11, struct aht20_threshold)
+#define AHT20_GET_THRESHOLD _IOWR(AHT20_IOCTL_MAGIC, 12, struct aht20_threshold)  // vao: channel
+#define AHT20_READ_EVENT _IOR(AHT20_IOCTL_MAGIC, 13, struct aht20_event)
+
+#ifndef __KERNEL__
+// Doc mau moi nhat khong can syscall; thu lai neu driver ghi giua chung
+static inline void aht20_shared_read(const struct aht20_shared *page, struct aht20_sample *out)
+{
+    __u32 begin, end;
+
+    do {
+        begin = __atomic_load_n(&page->lock_seq, __ATOMIC_ACQUIRE);
+        *out = page->sample;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        end = __atomic_load_n(&page->lock_seq, __ATOMIC_RELAXED);
+    } while ((begin & 1) || begin != end);
+}
+#endif
+
+#endif // AHT20_IOCTL_H
@@ -0,0 +1,223 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/i2c.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include "aht20_sim.h"
+
+// I2C adapter gia lap mot cam bien AHT20 o dia chi 0x38, de chay
+// aht20_driver va bench khi khong co phan cung:
+//   insmod aht20_sim.ko conv_us=80000 crc_error_ppm=1000 nak_ppm=500
+//   insmod aht20_driver.ko
+// Bo dem nam trong /sys/kernel/debug/aht20_sim/
+
+#define AHT20_ADDR 0x38
+#define AHT20_SIM_MAX_POINTS 16
+
+// Thoi gian chuyen doi va loi gia lap, doi duoc luc dang chay
+static unsigned int conv_us = 80000;
+module_param(conv_us, uint, 0644);
+MODULE_PARM_DESC(conv_us, "Conversion time in us, busy bit is set meanwhile");
+
+static unsigned int crc_error_ppm;
+module_param(crc_error_ppm, uint, 0644);
+MODULE_PARM_DESC(crc_error_ppm, "Frames sent with a corrupted CRC, per million");
+
+static unsigned int nak_ppm;
+module_param(nak_ppm, uint, 0644);
+MODULE_PARM_DESC(nak_ppm, "Messages NAKed, per million");
+
+static unsigned int seed = 1;
+module_param(seed, uint, 0444);
+MODULE_PARM_DESC(seed, "Seed of the fault injection");
+
+static bool attach = true;
+module_param(attach, bool, 0444);
+MODULE_PARM_DESC(attach, "Instantiate an aht20 client on the adapter");
+
+// Dang song: 0 const, 1 triangle, 2 square, 3 script (milli-degC, milli-%RH)
+static int temp_shape;
+module_param(temp_shape, int, 0444);
+static int temp_base = 25000;
+module_param(temp_base, int, 0444);
+static int temp_amp;
+module_param(temp_amp, int, 0444);
+static unsigned int temp_period_ms;
+module_param(temp_period_ms, uint, 0444);
+static int temp_script[2 * AHT20_SIM_MAX_POINTS];
+static int temp_script_n;
+module_param_array(temp_script, int, &temp_script_n, 0444);
+MODULE_PARM_DESC(temp_script, "Temperature points t_ms,value,t_ms,value,...");
+
+static int hum_shape;
+module_param(hum_shape, int, 0444);
+static int hum_base = 50000;
+module_param(hum_base, int, 0444);
+static int hum_amp;
+module_param(hum_amp, int, 0444);
+static unsigned int hum_period_ms;
+module_param(hum_period_ms, uint, 0444);
+static int hum_script[2 * AHT20_SIM_MAX_POINTS];
+static int hum_script_n;
+module_param_array(hum_script, int, &hum_script_n, 0444);
+MODULE_PARM_DESC(hum_script, "Humidity points t_ms,value,t_ms,value,...");
+
+static struct aht20_sim aht20_sim;
+static DEFINE_MUTEX(aht20_sim_lock);
+static struct aht20_sim_point temp_points[AHT20_SIM_MAX_POINTS];
+static struct aht20_sim_point hum_points[AHT20_SIM_MAX_POINTS];
+static struct i2c_client *aht20_sim_client;
+static struct dentry *aht20_sim_dir;
+
+static u64 aht20_sim_now_us(void)
+{
+    return ktime_to_us(ktime_get());
+}
+
+// Ham xu ly mot giao dich I2C: moi message la mot lenh hoac mot lan doc
+static int aht20_sim_xfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num)
+{
+    u64 now = aht20_sim_now_us();
+    int ret = num;
+    int i;
+
+    mutex_lock(&aht20_sim_lock);
+    aht20_sim.cfg.conversion_us = conv_us;
+    aht20_sim.cfg.crc_error_ppm = crc_error_ppm;
+    aht20_sim.cfg.nak_ppm = nak_ppm;
+
+    for (i = 0; i < num; i++) {
+        if (msgs[i].addr != AHT20_ADDR) {
+            ret = -ENXIO;
+            break;
+        }
+        // NAK huy phan con lai cua giao dich
+        if (aht20_sim_nak(&aht20_sim)) {
+            ret = -EREMOTEIO;
+            break;
+        }
+        if (msgs[i].flags & I2C_M_RD)
+            aht20_sim_read(&aht20_sim, msgs[i].buf, msgs[i].len, now);
+        else
+            aht20_sim_write(&aht20_sim, msgs[i].buf, msgs[i].len, now);
+    }
+    mutex_unlock(&aht20_sim_lock);
+    return ret;
+}
+
+static u32 aht20_sim_functionality(struct i2c_adapter *adap)
+{
+    return I2C_FUNC_I2C | I2C_FUNC_SMBUS_EMUL;
+}
+
+static const struct i2c_algorithm aht20_sim_algo = {
+    .master_xfer    = aht20_sim_xfer,
+    .functionality  = aht20_sim_functionality,
+};
+
+static struct i2c_adapter aht20_sim_adapter = {
+    .owner  = THIS_MODULE,
+    .class  = I2C_CLASS_HWMON,
+    .algo   = &aht20_sim_algo,
+    .name   = "AHT20 simulator",
+};
+
+// Ham doc mot dang song tu tham so module
+static int aht20_sim_wave(struct aht20_sim_wave *w, int shape, int base, int amp,
+                          unsigned int period_ms, const int *script, int script_n,
+                          struct aht20_sim_point *points)
+{
+    int i;
+
+    w->shape = shape;
+    w->base = base;
+    w->amplitude = amp;
+    w->period_ms = period_ms;
+
+    if (script_n) {
+        if (script_n % 2) {
+            printk(KERN_ERR "AHT20 sim: script needs t_ms,value pairs\n");
+            return -EINVAL;
+        }
+        for (i = 0; i < script_n / 2; i++) {
+            points[i].t_ms = script[2 * i];
+            points[i].value = script[2 * i + 1];
+        }
+        w->shape = AHT20_SIM_SCRIPT;
+        w->points = points;
+        w->npoints = script_n / 2;
+    }
+    return 0;
+}
+
+static void aht20_sim_debugfs(void)
+{
+    aht20_sim_dir = debugfs_create_dir("aht20_sim", NULL);
+    debugfs_create_u64("triggers", 0444, aht20_sim_dir, &aht20_sim.stats.triggers);
+    debugfs_create_u64("frames", 0444, aht20_sim_dir, &aht20_sim.stats.frames);
+    debugfs_create_u64("busy_frames", 0444, aht20_sim_dir, &aht20_sim.stats.busy_frames);
+    debugfs_create_u64("crc_errors", 0444, aht20_sim_dir, &aht20_sim.stats.crc_errors);
+    debugfs_create_u64("naks", 0444, aht20_sim_dir, &aht20_sim.stats.naks);
+    debugfs_create_u64("inits", 0444, aht20_sim_dir, &aht20_sim.stats.inits);
+    debugfs_create_u64("resets", 0444, aht20_sim_dir, &aht20_sim.stats.resets);
+}
+
+// Ham init
+static int __init aht20_sim_init_module(void)
+{
+    struct i2c_board_info info = { I2C_BOARD_INFO("aht20", AHT20_ADDR) };
+    struct aht20_sim_config cfg;
+    int ret;
+
+    aht20_sim_defaults(&cfg);
+    cfg.conversion_us = conv_us;
+    cfg.crc_error_ppm = crc_error_ppm;
+    cfg.nak_ppm = nak_ppm;
+    cfg.seed = seed;
+    ret = aht20_sim_wave(&cfg.temperature, temp_shape, temp_base, temp_amp, temp_period_ms,
+                         temp_script, temp_script_n, temp_points);
+    if (ret)
+        return ret;
+    ret = aht20_sim_wave(&cfg.humidity, hum_shape, hum_base, hum_amp, hum_period_ms,
+                         hum_script, hum_script_n, hum_points);
+    if (ret)
+        return ret;
+    aht20_sim_init(&aht20_sim, &cfg, aht20_sim_now_us());
+
+    ret = i2c_add_adapter(&aht20_sim_adapter);
+    if (ret) {
+        printk(KERN_ERR "AHT20 sim: failed to add adapter\n");
+        return ret;
+    }
+
+    if (attach) {
+        aht20_sim_client = i2c_new_client_device(&aht20_sim_adapter, &info);
+        if (IS_ERR(aht20_sim_client)) {
+            printk(KERN_ERR "AHT20 sim: failed to create client\n");
+            i2c_del_adapter(&aht20_sim_adapter);
+            return PTR_ERR(aht20_sim_client);
+        }
+    }
+
+    aht20_sim_debugfs();
+    printk(KERN_INFO "AHT20 simulator on i2c-%d\n", aht20_sim_adapter.nr);
+    return 0;
+}
+
+// Ham exit
+static void __exit aht20_sim_exit_module(void)
+{
+    debugfs_remove_recursive(aht20_sim_dir);
+    if (!IS_ERR_OR_NULL(aht20_sim_client))
+        i2c_unregister_device(aht20_sim_client);
+    i2c_del_adapter(&aht20_sim_adapter);
+}
+
+module_init(aht20_sim_init_module);
+module_exit(aht20_sim_exit_module);
+
+MODULE_AUTHOR("NamVanDuyCuong");
+MODULE_DESCRIPTION("Simulated AHT20 on a virtual I2C adapter");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,120 @@
+// Tracepoint cho duong do cua aht20_driver, thay cho printk:
+//   echo 1 > /sys/kernel/tracing/events/aht20/enable
+//   perf record -e 'aht20:*' ...
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM aht20
+
+#if !defined(_AHT20_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _AHT20_TRACE_H
+
+#include <linux/tracepoint.h>
+
+// Da gui 0xAC; status_probed: lan nay co hoi 0x71 truoc
+TRACE_EVENT(aht20_trigger,
+    TP_PROTO(int minor, bool status_probed),
+    TP_ARGS(minor, status_probed),
+    TP_STRUCT__entry(
+        __field(int, minor)
+        __field(bool, status_probed)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->status_probed = status_probed;
+    ),
+    TP_printk("aht20_dev%d status_probed=%d", __entry->minor, __entry->status_probed)
+);
+
+// Frame hop le: gia tri tho, status, thoi gian tu luc bat dau do va so lan poll
+TRACE_EVENT(aht20_complete,
+    TP_PROTO(int minor, u8 status, u32 raw_temperature, u32 raw_humidity,
+             u32 duration_us, u32 polls),
+    TP_ARGS(minor, status, raw_temperature, raw_humidity, duration_us, polls),
+    TP_STRUCT__entry(
+        __field(int, minor)
+        __field(u8, status)
+        __field(u32, raw_temperature)
+        __field(u32, raw_humidity)
+        __field(u32, duration_us)
+        __field(u32, polls)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->status = status;
+        __entry->raw_temperature = raw_temperature;
+        __entry->raw_humidity = raw_humidity;
+        __entry->duration_us = duration_us;
+        __entry->polls = polls;
+    ),
+    TP_printk("aht20_dev%d status=0x%02x raw_t=%u raw_h=%u duration_us=%u polls=%u",
+              __entry->minor, __entry->status, __entry->raw_temperature,
+              __entry->raw_humidity, __entry->duration_us, __entry->polls)
+);
+
+// CRC sai: byte CRC nhan duoc va gia tri tinh lai
+TRACE_EVENT(aht20_crc_error,
+    TP_PROTO(int minor, u8 status, u8 crc, u8 expected),
+    TP_ARGS(minor, status, crc, expected),
+    TP_STRUCT__entry(
+        __field(int, minor)
+        __field(u8, status)
+        __field(u8, crc)
+        __field(u8, expected)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->status = status;
+        __entry->crc = crc;
+        __entry->expected = expected;
+    ),
+    TP_printk("aht20_dev%d status=0x%02x crc=0x%02x expected=0x%02x",
+              __entry->minor, __entry->status, __entry->crc, __entry->expected)
+);
+
+// Frame con bit busy, se poll lai; elapsed_us tinh tu luc trigger
+TRACE_EVENT(aht20_retry,
+    TP_PROTO(int minor, u32 poll, u32 elapsed_us),
+    TP_ARGS(minor, poll, elapsed_us),
+    TP_STRUCT__entry(
+        __field(int, minor)
+        __field(u32, poll)
+        __field(u32, elapsed_us)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->poll = poll;
+        __entry->elapsed_us = elapsed_us;
+    ),
+    TP_printk("aht20_dev%d poll=%u elapsed_us=%u",
+              __entry->minor, __entry->poll, __entry->elapsed_us)
+);
+
+DECLARE_EVENT_CLASS(aht20_file,
+    TP_PROTO(int minor),
+    TP_ARGS(minor),
+    TP_STRUCT__entry(
+        __field(int, minor)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+    ),
+    TP_printk("aht20_dev%d", __entry->minor)
+);
+
+DEFINE_EVENT(aht20_file, aht20_open,
+    TP_PROTO(int minor),
+    TP_ARGS(minor)
+);
+
+DEFINE_EVENT(aht20_file, aht20_release,
+    TP_PROTO(int minor),
+    TP_ARGS(minor)
+);
+
+#endif // _AHT20_TRACE_H
+
+// Header nam ngoai include/trace/events: chi cho define_trace.h tim o day
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE aht20_trace
+#include <trace/define_trace.h>
@@ -2,31 +2,60 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <signal.h>
 #include <sys/ioctl.h>
-#include <stdint.h> 
-#include <errno.h> 
+#include <stdint.h>
+#include <errno.h>
 #include <string.h>
+#include <linux/spi/spidev.h>
 #include <wiringPi.h>
 #include <wiringPiSPI.h>
 
 #define spi0 0
+#define SPI_SPEED_HZ 1000000
 
-#define AHT20_IOCTL_MAGIC 'A'
-#define AHT20_IOCTL_MAGIC1 'B'
+#include "aht20_ioctl.h"
 
-#define AHT20_READ_TEMPERATURE _IOR(AHT20_IOCTL_MAGIC , 1, uint32_t)
-#define AHT20_READ_HUMIDITY _IOR(AHT20_IOCTL_MAGIC1, 0, uint32_t)
-#define AHT20_START _IO(AHT20_IOCTL_MAGIC, 2)
-#define AHT20_STOP _IO(AHT20_IOCTL_MAGIC, 3)
+#define DEVICE_PATH "/dev/aht20_dev0"
 
+// MAX7219 registers: digits are 0x01..0x08
+#define MAX7219_DIGITS 8
+#define MAX7219_DECODE_MODE 0x09
+#define MAX7219_INTENSITY 0x0A
+#define MAX7219_SCAN_LIMIT 0x0B
+#define MAX7219_SHUTDOWN 0x0C
+#define MAX7219_DISPLAY_TEST 0x0F
 
-#define DEVICE_PATH "/dev/aht20_dev"
+// Redraw in place: cursor home, then overwrite each line and clear its tail
+#define ANSI_CLEAR_SCREEN "\033[H\033[2J"
+#define ANSI_HOME "\033[H"
+#define ANSI_CLEAR_EOL "\033[K"
 
-#ifdef _WIN32
-#define CLEAR_COMMAND "cls"
-#else
-#define CLEAR_COMMAND "clear"
-#endif
+// SPI backend counters
+struct spi_stats {
+    unsigned long messages;     // SPI_IOC_MESSAGE calls (one syscall each)
+    unsigned long transfers;    // register writes, one CS pulse each
+    unsigned long bytes;
+};
+
+struct spi_backend {
+    int (*xfer)(struct spi_backend *spi, struct spi_ioc_transfer *xfers, int n);
+    int fd;                                     // spidev fd, -1 for the mock
+    struct spi_stats stats;
+};
+
+// Shadow framebuffer: fb is what we want shown, shadow what the MAX7219 holds.
+// Only digits whose byte changed are sent.
+struct display {
+    struct spi_backend *spi;
+    uint8_t fb[MAX7219_DIGITS];
+    uint8_t shadow[MAX7219_DIGITS];
+    uint8_t dirty;                              // bit i: digit register i + 1
+    unsigned long refreshes;
+    unsigned long skipped;                      // digit writes avoided
+};
+
+static volatile sig_atomic_t running = 1;
 
 uint8_t charTo7Segment(char c) {
     switch(c) {
@@ -45,145 +74,235 @@ uint8_t charTo7Segment(char c) {
     }
 }
 
-// Function to send data to MAX7219
-void sendData(uint8_t address, uint8_t value) {
-    uint8_t data[2];
-    data[0] = address;
-    data[1] = value;
-    wiringPiSPIDataRW(spi0, data, 2);
+// spidev backend: the whole batch goes out in one ioctl
+static int spi_hw_xfer(struct spi_backend *spi, struct spi_ioc_transfer *xfers, int n) {
+    if (ioctl(spi->fd, SPI_IOC_MESSAGE(n), xfers) < 0) {
+        perror("SPI_IOC_MESSAGE");
+        return -1;
+    }
+    return 0;
 }
 
-// Function to setup MAX7219
-void setup_max7912(){
-    if (wiringPiSPISetup(spi0, 1000000) < 0) {
-        fprintf(stderr, "SPI Setup failed: %s\n", strerror(errno));
-        exit(1);
+// Mock backend: no hardware, spi_write_regs() still counts every batch
+static int spi_mock_xfer(struct spi_backend *spi, struct spi_ioc_transfer *xfers, int n) {
+    (void)spi;
+    (void)xfers;
+    (void)n;
+    return 0;
+}
+
+// Function to send a batch of register writes. Each write is its own
+// transfer with cs_change set, so CS rises between them and the MAX7219
+// latches every word, but the batch costs one system call.
+int spi_write_regs(struct spi_backend *spi, const uint8_t (*words)[2], int n) {
+    struct spi_ioc_transfer xfers[MAX7219_DIGITS + 5];
+
+    if (n == 0) {
+        return 0;
     }
-    
-    // Setup MAX7219
-    sendData(0x09, 0x00); // no decode mode
-    sendData(0x0A, 0x08); // intensity
-    sendData(0x0B, 0x07); // scan limit
-    sendData(0x0C, 0x01); // normal operation mode
-    sendData(0x0F, 0x00); // turn off display test
+    memset(xfers, 0, sizeof(xfers));
+    for (int i = 0; i < n; i++) {
+        xfers[i].tx_buf = (uintptr_t)words[i];
+        xfers[i].len = 2;
+        xfers[i].speed_hz = SPI_SPEED_HZ;
+        xfers[i].bits_per_word = 8;
+        xfers[i].cs_change = i < n - 1;
+    }
+    if (spi->xfer(spi, xfers, n) < 0) {
+        return -1;
+    }
+    spi->stats.messages++;
+    spi->stats.transfers += n;
+    spi->stats.bytes += 2 * n;
+    return 0;
 }
 
-// Function to display temperature on MAX7219
-void displayTemperature(int temperature) {
-    // Convert temperature to integer for display
-    int data[4];
-    
-    //sendData(i + 5, charTo7Segment('-'));
-    if (temperature < 0)
-    {
-        temperature = temperature*(-1);
-        data[1] = temperature/100;
-        data[2] = (temperature/10)%10;
-        data[3] = temperature%10;
-
-        for(int i = 0; i < 4 ; i++)
-        {  
-            if(i == 3 ) sendData(i + 5, charTo7Segment('-'));
-            else if (i == 1) sendData (i+5, charTo7Segment(data[3 - i]) | 0b10000000);
-            else sendData(i+5, charTo7Segment(data[3 - i]));
-            
+// Function to setup MAX7219
+int setup_max7912(struct spi_backend *spi, int mock) {
+    static const uint8_t init[][2] = {
+        { MAX7219_DECODE_MODE, 0x00 },  // no decode mode
+        { MAX7219_INTENSITY, 0x08 },    // intensity
+        { MAX7219_SCAN_LIMIT, 0x07 },   // scan limit
+        { MAX7219_SHUTDOWN, 0x01 },     // normal operation mode
+        { MAX7219_DISPLAY_TEST, 0x00 }, // turn off display test
+    };
+
+    memset(spi, 0, sizeof(*spi));
+    if (mock) {
+        spi->fd = -1;
+        spi->xfer = spi_mock_xfer;
+    } else {
+        if (wiringPiSPISetup(spi0, SPI_SPEED_HZ) < 0) {
+            fprintf(stderr, "SPI Setup failed: %s\n", strerror(errno));
+            return -1;
         }
+        spi->fd = wiringPiSPIGetFd(spi0);
+        spi->xfer = spi_hw_xfer;
     }
-    else
-    {
-        data[1] = temperature/100;
-        data[2] = (temperature/10)%10;
-        data[3] = temperature%10;
-        for(int i = 0; i < 4 ; i++)
-        {  
-            if(i == 3 ) sendData(i + 5, 0);
-            else if (i == 1) sendData (i+5, charTo7Segment(data[3 - i]) | 0b10000000);
-            else sendData(i+5, charTo7Segment(data[3 - i]));
-            
+
+    return spi_write_regs(spi, init, sizeof(init) / sizeof(init[0]));
+}
+
+void display_init(struct display *disp, struct spi_backend *spi) {
+    memset(disp, 0, sizeof(*disp));
+    disp->spi = spi;
+    // Contents after power up are unknown: first flush writes every digit
+    disp->dirty = 0xFF;
+}
+
+void display_set(struct display *disp, int digit, uint8_t segments) {
+    disp->fb[digit] = segments;
+    if (disp->shadow[digit] != segments) {
+        disp->dirty |= 1 << digit;
+    }
+}
+
+// Function to send the changed digits in one SPI message
+int display_flush(struct display *disp) {
+    uint8_t words[MAX7219_DIGITS][2];
+    int n = 0;
+
+    disp->refreshes++;
+    for (int i = 0; i < MAX7219_DIGITS; i++) {
+        if (!(disp->dirty & (1 << i))) {
+            disp->skipped++;
+            continue;
         }
+        words[n][0] = i + 1;
+        words[n][1] = disp->fb[i];
+        n++;
+    }
+    if (spi_write_regs(disp->spi, (const uint8_t (*)[2])words, n) < 0) {
+        return -1;          // keep dirty, retry on the next refresh
+    }
+    memcpy(disp->shadow, disp->fb, sizeof(disp->fb));
+    disp->dirty = 0;
+    return 0;
+}
+
+// Function to display temperature on MAX7219 (digits 5..8)
+void displayTemperature(struct display *disp, int temperature) {
+    int negative = temperature < 0;
+
+    if (negative) {
+        temperature = temperature*(-1);
     }
-    
+    display_set(disp, 4, charTo7Segment(temperature%10));
+    display_set(disp, 5, charTo7Segment((temperature/10)%10) | 0b10000000);
+    display_set(disp, 6, charTo7Segment(temperature/100));
+    display_set(disp, 7, negative ? charTo7Segment('-') : 0);
 }
 
-// Function to display humidity on MAX7219
-void displayHumidity(int humidity) {
-    // Convert humidity to integer for display
-    int data[4];
-    data[0] = 0;
-    data[1] = humidity/100;
-    data[2] = (humidity/10)%10;
-    data[3] = humidity%10;
-    
-
-   for(int i = 0; i < 4 ; i++)
-   {
-        if (i == 3) sendData (i+1, 0);
-        else if (i == 1) sendData (i+1, charTo7Segment(data[3 - i]) | 0b10000000);
-        else sendData(i+1, charTo7Segment(data[3 - i]));
-        
-   }
+// Function to display humidity on MAX7219 (digits 1..4)
+void displayHumidity(struct display *disp, int humidity) {
+    display_set(disp, 0, charTo7Segment(humidity%10));
+    display_set(disp, 1, charTo7Segment((humidity/10)%10) | 0b10000000);
+    display_set(disp, 2, charTo7Segment(humidity/100));
+    display_set(disp, 3, 0);
 }
-void display_clear() {
-    // Convert humidity to integer for display
-    for (int i = 1 ; i < 9 ; i++)
+
+void display_clear(struct display *disp) {
+    for (int i = 0; i < MAX7219_DIGITS; i++)
     {
-        sendData(i,0);
+        display_set(disp, i, 0);
     }
 }
-int main() {
+
+static void stop_handler(int sig) {
+    (void)sig;
+    running = 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--mock-spi] [-n count] [device]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = DEVICE_PATH;
+    int mock = 0;
+    long count = 0;
     int fd;
     int humidity;
     int temperature;
+    struct aht20_sample sample;
+    struct spi_backend spi;
+    struct display disp;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mock-spi") == 0) {
+            mock = 1;
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            count = strtol(argv[++i], NULL, 10);
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return -1;
+        } else {
+            path = argv[i];
+        }
+    }
 
     // Open the device
-    fd = open(DEVICE_PATH, O_RDWR);
+    fd = open(path, O_RDWR);
     if (fd == -1) {
         perror("Failed to open the device");
         return -1;
     }
 
+    signal(SIGINT, stop_handler);
+    signal(SIGTERM, stop_handler);
 
     ioctl(fd, AHT20_START);
 
     // Setup MAX7219
-    setup_max7912();
-    display_clear();
+    if (setup_max7912(&spi, mock) < 0) {
+        close(fd);
+        return -1;
+    }
+    display_init(&disp, &spi);
+    display_clear(&disp);
+    display_flush(&disp);
 
-    
-    while (1){
-        // Read temperature from sensor
-        if (ioctl(fd, AHT20_READ_TEMPERATURE, &temperature) < 0) {
-            perror("Failed to perform ioctl");
-            close(fd);
-            return -1;
-        }
-        ioctl(fd, AHT20_STOP);
-        // Read humidity from sensor
-        if (ioctl(fd, AHT20_READ_HUMIDITY, &humidity) < 0) {
+    printf(ANSI_CLEAR_SCREEN);
+    for (long n = 0; running && (count == 0 || n < count); n++) {
+        // Read temperature and humidity from one conversion
+        if (ioctl(fd, AHT20_READ_SAMPLE, &sample) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
             perror("Failed to perform ioctl");
             close(fd);
             return -1;
         }
+        temperature = sample.temperature;
+        humidity = sample.humidity;
 
         // Convert temperature and humidity to float
         float temp = (float) temperature / 10.0;
         float hum = (float) humidity / 10.0;
         // temperature = -200; // nhiet do am
-        // Clear the screen
-        system(CLEAR_COMMAND);       
 
         // Display temperature and humidity
-        printf("Temperature: %.1f°C\n", temp);
-        printf("Humidity: %.1f%%\n", hum);
+        printf(ANSI_HOME "Temperature: %.1f°C" ANSI_CLEAR_EOL "\n", temp);
+        printf("Humidity: %.1f%%" ANSI_CLEAR_EOL "\n", hum);
 
         // Display temperature and humidity on MAX7219
-        displayTemperature(temperature);
-        displayHumidity(humidity);
-        
+        displayTemperature(&disp, temperature);
+        displayHumidity(&disp, humidity);
+        display_flush(&disp);
+
+        printf("SPI: %lu messages, %lu digit writes, %lu skipped" ANSI_CLEAR_EOL "\n",
+               spi.stats.messages, spi.stats.transfers, disp.skipped);
+        fflush(stdout);
+
         // Delay for one second
         usleep(500000); //0.5s
     }
 
+    // Per-digit writes cost one syscall per register on every refresh
+    printf("%lu refreshes: %lu SPI messages, %lu bytes (per-digit writes: %lu messages, %lu bytes)\n",
+           disp.refreshes, spi.stats.messages, spi.stats.bytes,
+           5 + disp.refreshes * MAX7219_DIGITS, 2 * (5 + disp.refreshes * MAX7219_DIGITS));
+
     ioctl(fd, AHT20_STOP);
     // Close the device
     close(fd);